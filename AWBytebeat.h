@@ -0,0 +1,377 @@
+#pragma once
+
+#include <cstdint>
+#include "AWSynthSource.h"
+
+namespace Audio {
+
+// Compiles a bytebeat expression at runtime into register bytecode, which is then run as an AWPatch callback.
+// Expressions use C syntax with unsigned 32-bit arithmetic and variables 't' (ticks) and 'p' (phase), e.g.
+// "t*((t>>9|t>>13)&25&t>>6)". Supported operators, from highest to lowest precedence: unary - ~ !, * / %, + -,
+// << >>, < <= > >=, == !=, &, ^, |. Division by zero gives 0 and shift amounts are taken modulo 32.
+// Constant subexpressions are folded and repeated subexpressions are evaluated only once.
+//
+// Usage:
+//     AWBytebeat beat;
+//     beat.compile("t*((t>>9|t>>13)&25&t>>6)");
+//     auto patch = AWPatch(AWBytebeat::callback, beat);
+class AWBytebeat {
+    
+    public:
+        
+        static constexpr std::uint32_t MAX_NODES = 48;   // Limits the number of distinct subexpressions
+        static constexpr std::uint32_t MAX_DEPTH = 16;   // Limits nesting of parentheses and unary operators
+        
+        constexpr explicit AWBytebeat() : _code{}, _regs{}, _length(0), _result(REG_ZERO) {}
+        
+        // Compiles the expression. Returns false if the expression has a syntax error or is too complex,
+        // in which case the bytebeat evaluates to zero. The code is rewritten in place, so don't compile while a voice
+        // is playing a patch that uses this bytebeat.
+        bool compile(const char* expr) {
+            Compiler compiler(expr);
+            std::int32_t root = compiler.parse();
+            if(root < 0) {
+                _length = 0;
+                _code[0] = {};
+                _result = REG_ZERO;
+                return false;
+            }
+            compiler.emit(*this, root);
+            return true;
+        }
+        
+        // Evaluates the compiled expression
+        inline std::uint32_t eval(std::uint32_t t, std::uint32_t p) {
+            std::uint32_t* regs = _regs;
+            regs[REG_T] = t;
+            regs[REG_P] = p;
+            
+            // Threaded dispatch: each handler jumps directly to the handler of the next instruction.
+            // Code is terminated by an instruction with a non-operation opcode.
+            static const void* const HANDLERS[] = {
+                &&end, &&end, &&end,
+                &&neg, &&bit_not, &&logic_not,
+                &&mul, &&div, &&mod, &&add, &&sub, &&shl, &&shr, &&lt, &&le, &&gt, &&ge, &&eq, &&ne,
+                &&bit_and, &&bit_xor, &&bit_or
+            };
+            
+            const Instruction* ins = _code;
+            #define AWBYTEBEAT_NEXT(expr) {                                                     \
+                std::uint32_t a = regs[ins->a];                                                 \
+                std::uint32_t b = regs[ins->b];                                                 \
+                (void)b;                                                                        \
+                regs[ins->dst] = (expr);                                                        \
+                ++ins;                                                                          \
+                goto *HANDLERS[ins->op];                                                        \
+            }
+            
+            goto *HANDLERS[ins->op];
+            neg: AWBYTEBEAT_NEXT(-a)
+            bit_not: AWBYTEBEAT_NEXT(~a)
+            logic_not: AWBYTEBEAT_NEXT(!a)
+            mul: AWBYTEBEAT_NEXT(a * b)
+            div: AWBYTEBEAT_NEXT(b ? a / b : 0)
+            mod: AWBYTEBEAT_NEXT(b ? a % b : 0)
+            add: AWBYTEBEAT_NEXT(a + b)
+            sub: AWBYTEBEAT_NEXT(a - b)
+            shl: AWBYTEBEAT_NEXT(a << (b&31))
+            shr: AWBYTEBEAT_NEXT(a >> (b&31))
+            lt: AWBYTEBEAT_NEXT(a < b)
+            le: AWBYTEBEAT_NEXT(a <= b)
+            gt: AWBYTEBEAT_NEXT(a > b)
+            ge: AWBYTEBEAT_NEXT(a >= b)
+            eq: AWBYTEBEAT_NEXT(a == b)
+            ne: AWBYTEBEAT_NEXT(a != b)
+            bit_and: AWBYTEBEAT_NEXT(a & b)
+            bit_xor: AWBYTEBEAT_NEXT(a ^ b)
+            bit_or: AWBYTEBEAT_NEXT(a | b)
+            #undef AWBYTEBEAT_NEXT
+            end:
+            
+            return regs[_result];
+        }
+        
+        // Callback function for AWPatch. Result is truncated to 8-bits and converted to signed value.
+        static std::int32_t callback(std::uint32_t t, std::uint32_t p, void* data) {
+            auto& self = *reinterpret_cast<AWBytebeat*>(data);
+            return (self.eval(t, p) & 255) - 128;
+        }
+        
+        // Number of bytecode instructions executed per sample
+        constexpr std::uint32_t length() const { return _length; }
+    
+    private:
+        
+        enum struct Op : std::uint8_t {
+            CONST, VAR_T, VAR_P,
+            NEG, NOT, LNOT,
+            MUL, DIV, MOD, ADD, SUB, SHL, SHR, LT, LE, GT, GE, EQ, NE, AND, XOR, OR
+        };
+        
+        struct Instruction {
+            std::uint8_t op;
+            std::uint8_t dst;
+            std::uint8_t a;
+            std::uint8_t b;
+        };
+        
+        static constexpr std::uint8_t REG_T = 0;
+        static constexpr std::uint8_t REG_P = 1;
+        static constexpr std::uint8_t REG_ZERO = MAX_NODES+2;   // Always zero, the result when there's no expression
+        
+        static constexpr std::uint32_t apply(Op op, std::uint32_t a, std::uint32_t b) {
+            switch(op) {
+                case Op::NEG: return -a;
+                case Op::NOT: return ~a;
+                case Op::LNOT: return !a;
+                case Op::MUL: return a * b;
+                case Op::DIV: return b ? a / b : 0;
+                case Op::MOD: return b ? a % b : 0;
+                case Op::ADD: return a + b;
+                case Op::SUB: return a - b;
+                case Op::SHL: return a << (b&31);
+                case Op::SHR: return a >> (b&31);
+                case Op::LT: return a < b;
+                case Op::LE: return a <= b;
+                case Op::GT: return a > b;
+                case Op::GE: return a >= b;
+                case Op::EQ: return a == b;
+                case Op::NE: return a != b;
+                case Op::AND: return a & b;
+                case Op::XOR: return a ^ b;
+                case Op::OR: return a | b;
+                default: return 0;
+            }
+        }
+        
+        // Recursive descent parser that builds a deduplicated expression graph. Every node is created after its
+        // operands, so the node array is already in evaluation order.
+        class Compiler {
+            
+            public:
+                
+                explicit Compiler(const char* str) : _str(str), _pos(0), _count(0), _depth(0), _error(false) {}
+                
+                std::int32_t parse() {
+                    std::int32_t root = parseBinary(0);
+                    skipWhitespace();
+                    return (_error || _str[_pos] != 0) ? -1 : root;
+                }
+                
+                void emit(AWBytebeat& out, std::int32_t root) {
+                    // Mark nodes that the result depends on. Folded constants may have left some nodes unused.
+                    bool used[MAX_NODES] = {};
+                    used[root] = true;
+                    for(std::int32_t idx = root; idx >= 0; --idx) {
+                        if(used[idx] && isOperation(_nodes[idx].op)) {
+                            used[_nodes[idx].a] = true;
+                            used[_nodes[idx].b] = true;
+                        }
+                    }
+                    
+                    // Registers 0 and 1 hold 't' and 'p', followed by constants and then intermediate results
+                    std::uint8_t reg[MAX_NODES] = {};
+                    std::uint32_t next = 2;
+                    for(std::uint32_t idx = 0; idx < _count; ++idx) {
+                        if(!used[idx]) continue;
+                        switch(_nodes[idx].op) {
+                            case Op::VAR_T: reg[idx] = REG_T; break;
+                            case Op::VAR_P: reg[idx] = REG_P; break;
+                            case Op::CONST: reg[idx] = next; out._regs[next++] = _nodes[idx].value; break;
+                            default: break;
+                        }
+                    }
+                    
+                    out._length = 0;
+                    for(std::uint32_t idx = 0; idx < _count; ++idx) {
+                        if(!used[idx] || !isOperation(_nodes[idx].op)) continue;
+                        reg[idx] = next++;
+                        out._code[out._length++] = {
+                            static_cast<std::uint8_t>(_nodes[idx].op), reg[idx], reg[_nodes[idx].a], reg[_nodes[idx].b]
+                        };
+                    }
+                    out._code[out._length] = {static_cast<std::uint8_t>(Op::CONST), 0, 0, 0};   // Terminator
+                    out._result = reg[root];
+                }
+            
+            private:
+                
+                struct Node {
+                    Op op;
+                    std::uint8_t a;
+                    std::uint8_t b;
+                    std::uint32_t value;
+                };
+                
+                static constexpr bool isOperation(Op op) { return op >= Op::NEG; }
+                
+                // Returns an existing node with identical contents, or adds a new one
+                std::int32_t node(Op op, std::int32_t a, std::int32_t b, std::uint32_t value) {
+                    if(_error) return -1;
+                    
+                    if(isOperation(op)) {
+                        bool unary = op <= Op::LNOT;
+                        if(unary) {
+                            b = a;
+                        }
+                        if(_nodes[a].op == Op::CONST && _nodes[b].op == Op::CONST) {
+                            // Fold constant subexpression
+                            return node(Op::CONST, 0, 0, apply(op, _nodes[a].value, _nodes[b].value));
+                        }
+                    }
+                    else {
+                        a = 0;
+                        b = 0;
+                    }
+                    
+                    for(std::uint32_t idx = 0; idx < _count; ++idx) {
+                        const Node& n = _nodes[idx];
+                        if(n.op == op && n.a == a && n.b == b && n.value == value) {
+                            return idx;
+                        }
+                    }
+                    
+                    if(_count >= MAX_NODES) {
+                        _error = true;
+                        return -1;
+                    }
+                    _nodes[_count] = {op, static_cast<std::uint8_t>(a), static_cast<std::uint8_t>(b), value};
+                    return _count++;
+                }
+                
+                void skipWhitespace() {
+                    while(_str[_pos] == ' ' || _str[_pos] == '\t' || _str[_pos] == '\n' || _str[_pos] == '\r') {
+                        ++_pos;
+                    }
+                }
+                
+                // Returns the binary operator at the current position and its precedence level (1 is the loosest),
+                // or precedence 0 if there is none. 'len' is set to the number of characters in the operator.
+                std::uint32_t peekOperator(Op& op, std::uint32_t& len) {
+                    skipWhitespace();
+                    char c0 = _str[_pos];
+                    char c1 = c0 ? _str[_pos+1] : 0;
+                    len = 1;
+                    switch(c0) {
+                        case '*': op = Op::MUL; return 9;
+                        case '/': op = Op::DIV; return 9;
+                        case '%': op = Op::MOD; return 9;
+                        case '+': op = Op::ADD; return 8;
+                        case '-': op = Op::SUB; return 8;
+                        case '<':
+                            if(c1 == '<') { op = Op::SHL; len = 2; return 7; }
+                            if(c1 == '=') { op = Op::LE; len = 2; return 6; }
+                            op = Op::LT; return 6;
+                        case '>':
+                            if(c1 == '>') { op = Op::SHR; len = 2; return 7; }
+                            if(c1 == '=') { op = Op::GE; len = 2; return 6; }
+                            op = Op::GT; return 6;
+                        case '=':
+                            if(c1 == '=') { op = Op::EQ; len = 2; return 5; }
+                            return 0;
+                        case '!':
+                            if(c1 == '=') { op = Op::NE; len = 2; return 5; }
+                            return 0;
+                        case '&': op = Op::AND; return c1 != '&' ? 4 : 0;
+                        case '^': op = Op::XOR; return 3;
+                        case '|': op = Op::OR; return c1 != '|' ? 2 : 0;
+                        default: return 0;
+                    }
+                }
+                
+                // Precedence climbing, all binary operators are left associative
+                std::int32_t parseBinary(std::uint32_t min_prec) {
+                    std::int32_t lhs = parseUnary();
+                    while(!_error) {
+                        Op op = Op::CONST;
+                        std::uint32_t len = 0;
+                        std::uint32_t prec = peekOperator(op, len);
+                        if(prec == 0 || prec <= min_prec) {
+                            break;
+                        }
+                        _pos += len;
+                        std::int32_t rhs = parseBinary(prec);
+                        lhs = node(op, lhs, rhs, 0);
+                    }
+                    return lhs;
+                }
+                
+                std::int32_t parseUnary() {
+                    if(++_depth > MAX_DEPTH) {
+                        _error = true;
+                        return -1;
+                    }
+                    
+                    std::int32_t result = -1;
+                    skipWhitespace();
+                    char c = _str[_pos];
+                    if(c == '-' || c == '~' || c == '!') {
+                        ++_pos;
+                        std::int32_t operand = parseUnary();
+                        result = node(c == '-' ? Op::NEG : (c == '~' ? Op::NOT : Op::LNOT), operand, operand, 0);
+                    }
+                    else if(c == '+') {
+                        ++_pos;
+                        result = parseUnary();
+                    }
+                    else if(c == '(') {
+                        ++_pos;
+                        result = parseBinary(0);
+                        skipWhitespace();
+                        if(_str[_pos] == ')') {
+                            ++_pos;
+                        }
+                        else {
+                            _error = true;
+                        }
+                    }
+                    else if(c == 't') {
+                        ++_pos;
+                        result = node(Op::VAR_T, 0, 0, 0);
+                    }
+                    else if(c == 'p') {
+                        ++_pos;
+                        result = node(Op::VAR_P, 0, 0, 0);
+                    }
+                    else if(c >= '0' && c <= '9') {
+                        std::uint32_t value = 0;
+                        if(c == '0' && (_str[_pos+1] == 'x' || _str[_pos+1] == 'X')) {
+                            _pos += 2;
+                            for(;; ++_pos) {
+                                char h = _str[_pos];
+                                if(h >= '0' && h <= '9') value = 16*value + (h - '0');
+                                else if(h >= 'a' && h <= 'f') value = 16*value + (h - 'a' + 10);
+                                else if(h >= 'A' && h <= 'F') value = 16*value + (h - 'A' + 10);
+                                else break;
+                            }
+                        }
+                        else {
+                            while(_str[_pos] >= '0' && _str[_pos] <= '9') {
+                                value = 10*value + (_str[_pos++] - '0');
+                            }
+                        }
+                        result = node(Op::CONST, 0, 0, value);
+                    }
+                    else {
+                        _error = true;
+                    }
+                    
+                    --_depth;
+                    return _error ? -1 : result;
+                }
+                
+                const char* _str;
+                std::uint32_t _pos;
+                std::uint32_t _count;
+                std::uint32_t _depth;
+                bool _error;
+                Node _nodes[MAX_NODES];
+        };
+        
+        Instruction _code[MAX_NODES+1];
+        std::uint32_t _regs[MAX_NODES+3];
+        std::uint8_t _length;
+        std::uint8_t _result;
+};
+
+} // namespace Audio
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <LibAudio>
+#include "AWSynthSource.h"
+
+// Control-ahead voices. A voice played with AWControlAhead<channel>::play() has its control values (envelopes, glide,
+// gain and pitch) for the next buffers computed whenever computeAhead() is called from the main loop or, in the desktop
+// build, from a worker thread. The audio buffer fill then only runs the oscillators and interpolates the gain, and
+// takes the control values from the computed frames instead of updating them. Frames are kept in two slots, so one can
+// be computed while the other is played. If the frames for a buffer aren't ready in time, the buffer fill updates the
+// control values itself as usual. Usage:
+//     Audio::AWControlAhead<1>::play(patch, 60);
+//     Audio::AWControlAhead<1>::computeAhead();   // In the main loop, e.g. once per frame
+// play(), release() and computeAhead() must not run at the same time. release() only sets a flag that the next buffer
+// fill takes, so it is safe while the fill runs on another thread, but play() is not, like AWSynthSource::play(). A
+// channel should be played either through AWControlAhead or through AWSynthSource, not both. FM voices update their
+// operators along with the control values, so they are always updated in the buffer fill.
+// RAM: on top of its voice, each channel keeps two slots, each with a full copy of AWSynthSource and its frames.
+
+#ifdef PROJ_AWSYNTH_HOTSWAP
+#error "AWControlAhead.h can't be used with PROJ_AWSYNTH_HOTSWAP"
+#endif
+
+namespace Audio {
+
+template<std::uint32_t channel>
+class AWControlAhead {
+    
+    static_assert(!AWEffectsBus::reserves(channel), "Channel is used by the effects bus");
+    
+    static constexpr std::int32_t SLOTS = 2;
+    
+    public:
+        
+        static AWControlAhead& getInstance() {
+            static AWControlAhead self;
+            return self;
+        }
+        
+        template<bool lowLatency=true>
+        static AWControlAhead& play(const AWPatch& patch, std::uint8_t midikey=48) {
+            AWSYNTH_TRACE(PLAY, channel, audio_playHead);
+            
+            auto& self = getInstance();
+            auto& voice = self._voice;
+            // Frames computed for the previous note are dropped
+            self._generation.store(self._generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            self._release.store(false, std::memory_order_relaxed);
+            voice._channel = channel;
+            voice.init(patch, midikey);
+            AWSYNTH_TRACE(INIT, channel, 0);
+            
+            using Generator = AWSynthSource::Generator;
+            self._ahead = true;
+            switch(voice.select(patch)) {
+                case Generator::FM:
+                    self._render = render<Generator::FM>;
+                    self._ahead = false;
+                    break;
+                
+                case Generator::PLUCK:
+                    self._render = render<Generator::PLUCK>;
+                    break;
+                
+                case Generator::WITH_DATA:
+                    self._render = render<Generator::WITH_DATA>;
+                    break;
+                
+                default:
+                    self._render = render<Generator::PLAIN>;
+                    break;
+            }
+            
+            if(lowLatency) {
+                // Check if the last audio buffer has already been filled, and if so, add to it without sending
+                std::uint32_t idx = audio_playHead >> 9;
+                std::uint32_t last = (idx - 1) & (bufferCount - 1);
+                if(audio_state[last]) {
+                    self._render(voice, audio_buffer + last*512, true, false, nullptr);
+                }
+            }
+            
+            self._playing.store(true, std::memory_order_release);
+            Audio::connect(channel, &self, process);
+            return self;
+        }
+        
+        // The next buffer fill releases the voice and drops the frames computed before the release
+        inline void release() { _release.store(true, std::memory_order_release); }
+        
+        inline void send(std::uint8_t val) { _voice.send(val); }
+        
+        // Computes the control frames of the buffers that will be requested next, two at most. Call from the main loop
+        // or a worker thread, not from the audio interrupt. Returns the number of buffers computed.
+        static std::uint32_t computeAhead() {
+            auto& self = getInstance();
+            
+            std::uint32_t count = 0;
+            while(self._playing.load(std::memory_order_acquire) && self._ahead &&
+                  static_cast<std::int32_t>(self._produced.load(std::memory_order_relaxed) -
+                                            self._consumed.load(std::memory_order_acquire)) < SLOTS) {
+                if(!self.computeSlot()) {
+                    break;
+                }
+                ++count;
+            }
+            return count;
+        }
+        
+        // Number of buffers filled with frames computed ahead, and with control values updated in the buffer fill
+        static std::uint32_t framedBuffers() { return getInstance()._framed.load(std::memory_order_relaxed); }
+        static std::uint32_t inlineBuffers() { return getInstance()._inline.load(std::memory_order_relaxed); }
+    
+    private:
+        
+        using ControlFrame = AWSynthSource::ControlFrame;
+        using Render = bool (*)(AWSynthSource& voice, std::uint8_t* buffer, bool mixing, bool sending, const ControlFrame* frames);
+        
+        // Copy of the voice and the control frames of one buffer, 16 frames of 44 bytes. The frames are only played if
+        // nothing has changed the voice since they were computed.
+        struct Slot {
+            AWSynthSource voice;        // Control values of the voice at the end of the buffer
+            ControlFrame frames[AWSynthSource::_MAX_CONTROL_FRAMES];
+            std::uint32_t seq;
+            std::uint32_t generation;
+        };
+        
+        template<AWSynthSource::Generator generator>
+        static bool render(AWSynthSource& voice, std::uint8_t* buffer, bool mixing, bool sending, const ControlFrame* frames) {
+            if constexpr(generator != AWSynthSource::Generator::FM) {
+                if(frames != nullptr) {
+                    return voice.template renderLoop<generator, true>(buffer, mixing, sending, frames);
+                }
+            }
+            return voice.template renderLoop<generator>(buffer, mixing, sending);
+        }
+        
+        // Computes the frames of the buffer after the last computed one. Frames are produced here and played in the audio
+        // interrupt, so each counter has only one writer. The buffer fill changes _seq before and after it updates the
+        // control values itself, so if the voice was copied while it changed, the frames are thrown away here or in the
+        // fill. Frames computed before a release or play() are stale too, and only the fill drops them. A slot is
+        // published with a release store of _produced and freed with one of _consumed.
+        bool computeSlot() {
+            std::uint32_t produced = _produced.load(std::memory_order_relaxed);
+            std::uint32_t seq = _seq.load(std::memory_order_acquire);
+            std::uint32_t generation = _generation.load(std::memory_order_acquire);
+            auto& slot = _slots[produced % SLOTS];
+            
+            if(produced == _consumed.load(std::memory_order_acquire)) {
+                slot.voice = _voice;
+            }
+            else {
+                const auto& last = _slots[(produced - 1) % SLOTS];
+                if(last.seq != seq || last.generation != generation) {
+                    return false;
+                }
+                slot.voice = last.voice;
+            }
+            slot.voice.computeFrames(slot.frames);
+            slot.seq = seq;
+            slot.generation = generation;
+            
+            std::atomic_thread_fence(std::memory_order_acquire);    // Voice is read before _seq is checked again
+            if(seq != _seq.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            _produced.store(produced + 1, std::memory_order_release);
+            return true;
+        }
+        
+        static void process(std::uint8_t* buffer, void* ptr) {
+            auto& self = *reinterpret_cast<AWControlAhead*>(ptr);
+            AWSYNTH_TRACE(FILL_START, channel, audio_playHead);
+            
+            // Loads and stores only, as the Cortex-M0 has no atomic read-modify-write. A release() in between is the
+            // same release.
+            if(self._release.load(std::memory_order_acquire)) {
+                self._release.store(false, std::memory_order_relaxed);
+                self._voice.release();
+                self.changed();
+            }
+            
+            bool playing;
+            std::uint32_t consumed = self._consumed.load(std::memory_order_relaxed);
+            std::uint32_t produced = self._produced.load(std::memory_order_acquire);
+            const auto& slot = self._slots[consumed % SLOTS];
+            if(static_cast<std::int32_t>(produced - consumed) > 0 && slot.seq == self._seq.load(std::memory_order_relaxed) &&
+               slot.generation == self._generation.load(std::memory_order_acquire)) {
+                playing = self._render(self._voice, buffer, channel != 0, true, slot.frames);
+                self._consumed.store(consumed + 1, std::memory_order_release);
+                self._framed.store(self._framed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            else {
+                // Frames are late or stale, so they are dropped and the control values are updated here
+                self._consumed.store(produced, std::memory_order_release);
+                self.changed();
+                std::atomic_thread_fence(std::memory_order_release);    // _seq changes before the voice does
+                playing = self._render(self._voice, buffer, channel != 0, true, nullptr);
+                self.changed();
+                self._inline.store(self._inline.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            
+            if(!playing) {
+                AWSYNTH_TRACE(STOP, channel, 0);
+                self._playing.store(false, std::memory_order_release);
+                Audio::stop<channel>();
+            }
+            AWSYNTH_TRACE(FILL_END, channel, audio_playHead);
+        }
+        
+        // Marks a change of the voice in the buffer fill, which is the only writer of _seq
+        inline void changed() {
+            _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+        
+        AWSynthSource _voice;
+        Render _render = nullptr;
+        bool _ahead = false;
+        std::atomic<bool> _playing{false};
+        
+        std::atomic<bool> _release{false};
+        
+        // Counters of buffers computed ahead and played or dropped, of changes to the voice in the buffer fill and of
+        // notes played. The fill drops frames by catching up with _produced, so _consumed never passes it.
+        std::atomic<std::uint32_t> _produced{0};
+        std::atomic<std::uint32_t> _consumed{0};
+        std::atomic<std::uint32_t> _seq{0};
+        std::atomic<std::uint32_t> _generation{0};
+        
+        std::atomic<std::uint32_t> _framed{0};
+        std::atomic<std::uint32_t> _inline{0};
+        
+        Slot _slots[SLOTS];
+};
+
+} // namespace Audio
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <LibAudio>
+
+namespace Audio {
+
+#ifdef PROJ_AWSYNTH_EFFECTS
+
+// Shared post-mix effects bus with a feedback delay and a one-pole low-pass filter.
+// Voices add a scaled copy of their output to the send buffer while they are rendered (see AWPatch::send()), and the
+// bus processes the sum once per buffer on its own channel. The channel is the last one, so that every voice has been
+// mixed before the bus runs, and voices can't be played on it. The cost is the same no matter how many voices are
+// sending to it.
+class AWEffectsBus {
+    
+    public:
+        
+        // Delay line length in samples, must be a power of two
+        static constexpr std::uint32_t DELAY_SIZE = 2048;
+        
+        static constexpr unsigned CHANNEL = NUM_CHANNELS-1;
+        
+        // True for the channel of the bus. Voices are not played on it.
+        static constexpr bool reserves(unsigned channel) { return channel == CHANNEL; }
+        
+        static AWEffectsBus& getInstance() { static AWEffectsBus self; return self; }
+        
+        template<unsigned channel=CHANNEL>
+        static AWEffectsBus& enable() {
+            static_assert(channel == CHANNEL, "Effects bus runs on the last channel");
+            
+            auto& self = getInstance();
+            self.clear();
+            _enabled = true;
+            Audio::connect(channel, &self, process);
+            return self;
+        }
+        
+        template<unsigned channel=CHANNEL>
+        static void disable() {
+            _enabled = false;
+            Audio::stop<channel>();
+        }
+        
+        // Delay time in milliseconds. Limited to the length of the delay line.
+        AWEffectsBus& delay(std::uint32_t ms) {
+            _delay = delayLength(ms * POK_AUD_FREQ / 1000);
+            return *this;
+        }
+        
+        // Amount of delayed signal fed back into the delay line, 0...100 %
+        AWEffectsBus& feedback(std::uint8_t val) { _feedback_Q8 = ((val < 100 ? val : 100) << 8) / 100; return *this; }
+        
+        // Low-pass filter coefficient, 0...100 %. 100 lets everything through, lower values give a darker sound.
+        AWEffectsBus& lowpass(std::uint8_t val) { _lowpass_Q8 = ((val < 100 ? val : 100) << 8) / 100; return *this; }
+        
+        // Output level of the bus, 0...100 %
+        AWEffectsBus& level(std::uint8_t val) { _level_Q8 = ((val < 100 ? val : 100) << 8) / 100; return *this; }
+        
+        // Returns the buffer where voices add their send signal, or nullptr if the bus is not running
+        static inline std::int16_t* sendBuffer() { return _enabled ? _send : nullptr; }
+    
+    private:
+        
+        static constexpr std::uint32_t delayLength(std::uint32_t len) {
+            return len > 0 ? (len < DELAY_SIZE ? len : DELAY_SIZE-1) : 1;
+        }
+        
+        // Default delay is 125 ms, or as long as the delay line allows at high sample rates
+        constexpr explicit AWEffectsBus() :
+            _pos(0), _delay(delayLength(POK_AUD_FREQ/8)), _feedback_Q8(128), _lowpass_Q8(160), _level_Q8(256), _lowpass_state_Q8(0)
+        {
+        }
+        
+        void clear() {
+            for(std::uint32_t idx = 0; idx < DELAY_SIZE; ++idx) {
+                _line[idx] = 0;
+            }
+            for(std::uint32_t idx = 0; idx < 512; ++idx) {
+                _send[idx] = 0;
+            }
+            _lowpass_state_Q8 = 0;
+        }
+        
+        static void process(std::uint8_t* buffer, void* ptr) {
+            auto& self = *reinterpret_cast<AWEffectsBus*>(ptr);
+            
+            std::uint32_t pos = self._pos;
+            std::int32_t lp_Q8 = self._lowpass_state_Q8;
+            for(std::uint32_t idx = 0; idx < 512; ++idx) {
+                std::int32_t delayed = _line[(pos - self._delay) & (DELAY_SIZE-1)];
+                std::int32_t in = _send[idx] + ((delayed*self._feedback_Q8) >> 8);
+                _send[idx] = 0;
+                
+                lp_Q8 += ((in*256 - lp_Q8)*self._lowpass_Q8) >> 8;
+                
+                std::int32_t val = (lp_Q8 + 128) >> 8;
+                val = val > -128 ? (val < 127 ? val : 127) : -128;              // Clip to 8-bits
+                _line[pos] = val;
+                pos = (pos + 1) & (DELAY_SIZE-1);
+                
+                buffer[idx] = Audio::mix(buffer[idx], ((val*self._level_Q8) >> 8) + 128);
+            }
+            
+            self._pos = pos;
+            self._lowpass_state_Q8 = lp_Q8;
+        }
+        
+        std::uint32_t _pos;
+        std::uint32_t _delay;
+        std::int32_t _feedback_Q8;
+        std::int32_t _lowpass_Q8;
+        std::int32_t _level_Q8;
+        std::int32_t _lowpass_state_Q8;
+        
+        static inline bool _enabled = false;
+        static inline std::int16_t _send[512] = {};
+
+#if defined(POKITTO) && defined(PROJ_HIGH_RAM) && PROJ_HIGH_RAM != HIGH_RAM_OFF
+        // Delay line is placed in the extra RAM region, which the linker script leaves out of the heap and the sections.
+        // PokittoLib only puts the sound buffers in its first 2 kB in HIGH_RAM_MUSIC mode, so the DELAY_SIZE bytes
+        // after them belong to the bus. Code of the program that uses the extra RAM too must keep out of them.
+        static constexpr std::uintptr_t _LINE_ADDRESS = PROJ_HIGH_RAM == HIGH_RAM_MUSIC ? 0x20004000 : 0x20000000;
+        static inline std::int8_t* const _line = reinterpret_cast<std::int8_t*>(_LINE_ADDRESS);
+#else
+        static inline std::int8_t _line[DELAY_SIZE] = {};
+#endif
+};
+
+#else
+
+// Effects bus is disabled. Voices see a null send buffer and the send code is optimized away.
+class AWEffectsBus {
+    public:
+        static constexpr bool reserves(unsigned channel) { return false; }
+        static constexpr std::int16_t* sendBuffer() { return nullptr; }
+};
+
+#endif
+
+} // namespace Audio
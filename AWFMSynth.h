@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include "AWSynthSource.h"
+
+namespace Audio {
+
+namespace AWFM {
+    
+    // Operator routing algorithms. Operator 1 has index 0.
+    // MODULATORS[i] has a bit set for every operator that modulates operator i. Modulators must have a higher index
+    // than the operators they modulate. CARRIERS has a bit set for every operator that is mixed to the output.
+    // Feedback takes the output of operator FEEDBACK_FROM and adds it to the phase of operator FEEDBACK_TO.
+    
+    // 2 -> 1
+    struct Serial2 {
+        static constexpr std::uint8_t COUNT = 2;
+        static constexpr std::uint8_t MODULATORS[COUNT] = {0b10, 0};
+        static constexpr std::uint8_t CARRIERS = 0b01;
+        static constexpr std::uint8_t FEEDBACK_FROM = 1;
+        static constexpr std::uint8_t FEEDBACK_TO = 1;
+    };
+    
+    // 1 + 2
+    struct Parallel2 {
+        static constexpr std::uint8_t COUNT = 2;
+        static constexpr std::uint8_t MODULATORS[COUNT] = {0, 0};
+        static constexpr std::uint8_t CARRIERS = 0b11;
+        static constexpr std::uint8_t FEEDBACK_FROM = 0;
+        static constexpr std::uint8_t FEEDBACK_TO = 0;
+    };
+    
+    // 3 -> 2 -> 1
+    struct Serial3 {
+        static constexpr std::uint8_t COUNT = 3;
+        static constexpr std::uint8_t MODULATORS[COUNT] = {0b010, 0b100, 0};
+        static constexpr std::uint8_t CARRIERS = 0b001;
+        static constexpr std::uint8_t FEEDBACK_FROM = 2;
+        static constexpr std::uint8_t FEEDBACK_TO = 2;
+    };
+    
+    // (2 + 3) -> 1, with feedback from 1 to 2
+    struct Branch3 {
+        static constexpr std::uint8_t COUNT = 3;
+        static constexpr std::uint8_t MODULATORS[COUNT] = {0b110, 0, 0};
+        static constexpr std::uint8_t CARRIERS = 0b001;
+        static constexpr std::uint8_t FEEDBACK_FROM = 0;
+        static constexpr std::uint8_t FEEDBACK_TO = 1;
+    };
+    
+    // 4 -> 3 -> 2 -> 1
+    struct Serial4 {
+        static constexpr std::uint8_t COUNT = 4;
+        static constexpr std::uint8_t MODULATORS[COUNT] = {0b0010, 0b0100, 0b1000, 0};
+        static constexpr std::uint8_t CARRIERS = 0b0001;
+        static constexpr std::uint8_t FEEDBACK_FROM = 3;
+        static constexpr std::uint8_t FEEDBACK_TO = 3;
+    };
+    
+    // (2 + 3 + 4) -> 1
+    struct Branch4 {
+        static constexpr std::uint8_t COUNT = 4;
+        static constexpr std::uint8_t MODULATORS[COUNT] = {0b1110, 0, 0, 0};
+        static constexpr std::uint8_t CARRIERS = 0b0001;
+        static constexpr std::uint8_t FEEDBACK_FROM = 3;
+        static constexpr std::uint8_t FEEDBACK_TO = 3;
+    };
+    
+    // (2 -> 1) + (4 -> 3)
+    struct Pairs4 {
+        static constexpr std::uint8_t COUNT = 4;
+        static constexpr std::uint8_t MODULATORS[COUNT] = {0b0010, 0, 0b1000, 0};
+        static constexpr std::uint8_t CARRIERS = 0b0101;
+        static constexpr std::uint8_t FEEDBACK_FROM = 3;
+        static constexpr std::uint8_t FEEDBACK_TO = 3;
+    };
+    
+    template<typename Algorithm>
+    constexpr bool isValid() {
+        if(Algorithm::COUNT < 1 || Algorithm::COUNT > AWFMState::MAX_OPERATORS) return false;
+        if(Algorithm::FEEDBACK_FROM >= Algorithm::COUNT || Algorithm::FEEDBACK_TO >= Algorithm::COUNT) return false;
+        for(std::uint32_t idx = 0; idx < Algorithm::COUNT; ++idx) {
+            if(Algorithm::MODULATORS[idx] & ((2<<idx) - 1)) return false;
+        }
+        return true;
+    }
+    
+    // Renders operators from 'idx' down to operator 1 and returns the sum of carriers. Routing and pitch ratios are
+    // known at compile time, so this unrolls into straight code without table lookups.
+    template<typename Algorithm, const auto& Operators, std::int32_t idx>
+    inline std::int32_t renderOperators(AWFMState& state, std::uint32_t p, std::int32_t (&out)[Algorithm::COUNT]) {
+        std::int32_t mod = (idx == Algorithm::FEEDBACK_TO) ? state.feedback : 0;
+        for(std::int32_t src = idx+1; src < Algorithm::COUNT; ++src) {
+            if(Algorithm::MODULATORS[idx] & (1<<src)) {
+                mod += out[src];
+            }
+        }
+        
+        constexpr std::uint32_t RATIO_Q8 = Operators[idx]._ratio_Q8;
+        std::uint32_t phase = (RATIO_Q8 & 255) ? ((p * RATIO_Q8) >> 8) : (p * (RATIO_Q8 >> 8));
+        out[idx] = AWSynthSource::sin(phase + mod) * state.gain_Q10[idx] / (1<<10);
+        
+        std::int32_t sum = (Algorithm::CARRIERS & (1<<idx)) ? out[idx] : 0;
+        if constexpr(idx > 0) {
+            sum += renderOperators<Algorithm, Operators, idx-1>(state, p, out);
+        }
+        return sum;
+    }
+    
+    // Renders one sample of the FM voice
+    template<typename Algorithm, const auto& Operators>
+    std::int32_t render(AWFMState& state, std::uint32_t p) {
+        static_assert(isValid<Algorithm>(), "Invalid FM algorithm");
+        static_assert(sizeof(Operators) == Algorithm::COUNT*sizeof(AWFMOperator), "Number of operators doesn't match the algorithm");
+        
+        std::int32_t out[Algorithm::COUNT];
+        std::int32_t sum = renderOperators<Algorithm, Operators, Algorithm::COUNT-1>(state, p, out);
+        
+        state.feedback = out[Algorithm::FEEDBACK_FROM] * state.feedback_gain_Q10 / (1<<10);
+        return sum;
+    }
+    
+    // Creates a patch that plays the operator table using the given routing algorithm. The table must be declared
+    // static constexpr, for example:
+    //     static constexpr AWFMOperator OPERATORS[] = {{1, 100}, {3, 45, 0, 200, 0}, {1, 25}};
+    //     auto fm_patch = AWFM::patch<AWFM::Branch3, OPERATORS>().feedback(25);
+    template<typename Algorithm, const auto& Operators>
+    constexpr AWPatch patch() {
+        return AWPatch(render<Algorithm, Operators>, Operators, Algorithm::CARRIERS);
+    }
+
+} // namespace AWFM
+
+} // namespace Audio
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace Audio {
+
+namespace internal {
+    
+    template<unsigned Bits, bool Signed>
+    struct FixedStorage {
+        static_assert(Bits > 0 && Bits <= 64, "Fixed point numbers have 1...64 bits");
+        using type = std::conditional_t<(Bits <= 8), std::conditional_t<Signed, std::int8_t, std::uint8_t>,
+                     std::conditional_t<(Bits <= 16), std::conditional_t<Signed, std::int16_t, std::uint16_t>,
+                     std::conditional_t<(Bits <= 32), std::conditional_t<Signed, std::int32_t, std::uint32_t>,
+                                                      std::conditional_t<Signed, std::int64_t, std::uint64_t>>>>;
+    };
+
+}
+
+// Fixed point number with 'Frac' fractional bits. 'Bits' is the number of bits the values need, sign included, and
+// picks the smallest integer to store them in. It is a promise that isn't checked at run time, but it lets the types
+// track how large results can get: products are computed in 32 bits when the bits of the factors fit into 32, and in
+// 64 bits otherwise, and a format that would need more than 64 bits doesn't compile.
+// Conversions to fewer fractional bits are arithmetic right shifts, which round toward minus infinity. Unlike signed
+// divides by powers of two, they need no fix-up instructions for negative values.
+template<unsigned Bits, unsigned Frac, bool Signed=true>
+struct Fixed {
+    using Raw = typename internal::FixedStorage<Bits, Signed>::type;
+    
+    static constexpr unsigned BITS = Bits;
+    static constexpr unsigned FRAC = Frac;
+    static constexpr bool SIGNED = Signed;
+    
+    Raw raw;
+    
+    Fixed() = default;
+    
+    // Values convert implicitly to formats with the same fractional bits that can hold their whole range
+    template<unsigned B, bool S, typename = std::enable_if_t<(Signed || !S) && (B + (Signed && !S) <= Bits)>>
+    constexpr Fixed(Fixed<B, Frac, S> other) : raw(other.raw) {}
+    
+    static constexpr Fixed fromRaw(std::int64_t val) { Fixed result{}; result.raw = static_cast<Raw>(val); return result; }
+    static constexpr Fixed fromInt(std::int64_t val) { return fromRaw(val * (static_cast<std::int64_t>(1) << Frac)); }
+    static constexpr Fixed fromDouble(double val) {
+        return fromRaw(static_cast<std::int64_t>(val * static_cast<double>(static_cast<std::uint64_t>(1) << Frac) + (val < 0 ? -0.5 : 0.5)));
+    }
+    static constexpr Fixed one() { return fromInt(1); }
+    
+    // True if 'val' can be held in 'Bits' bits. Used to check the ranges of narrow fields at compile time.
+    static constexpr bool holds(double val) {
+        constexpr double SCALE = static_cast<double>(static_cast<std::uint64_t>(1) << Frac);
+        constexpr double MAX = static_cast<double>(static_cast<std::uint64_t>(1) << (Signed ? Bits-1 : Bits)) - 1;
+        constexpr double MIN = Signed ? -MAX - 1 : 0;
+        return val*SCALE <= MAX && val*SCALE >= MIN;
+    }
+    
+    // Converts to 'F' fractional bits. The number of bits grows or shrinks with the shift.
+    template<unsigned F>
+    constexpr auto to() const {
+        if constexpr(F >= Frac) {
+            using Result = Fixed<Bits + (F-Frac), F, Signed>;
+            return Result::fromRaw(static_cast<typename Result::Raw>(raw) * (static_cast<typename Result::Raw>(1) << (F-Frac)));
+        }
+        else {
+            using Result = Fixed<(Bits > Frac-F ? Bits - (Frac-F) : 1), F, Signed>;
+            return Result::fromRaw(raw >> (Frac-F));
+        }
+    }
+    
+    // Same as above, but rounds to nearest
+    template<unsigned F>
+    constexpr auto round() const {
+        static_assert(F < Frac);
+        return Fixed<Bits+1, Frac, Signed>::fromRaw(raw + (static_cast<Raw>(1) << (Frac-F-1))).template to<F>();
+    }
+    
+    // Reinterprets the value with another bit count, when its range is known to be narrower or wider than the type says
+    template<unsigned B, bool S=Signed>
+    constexpr Fixed<B, Frac, S> as() const { return Fixed<B, Frac, S>::fromRaw(raw); }
+    
+    constexpr std::int32_t toInt() const { return raw >> Frac; }
+    
+    constexpr Fixed operator+(Fixed other) const { return fromRaw(raw + other.raw); }
+    constexpr Fixed operator-(Fixed other) const { return fromRaw(raw - other.raw); }
+    constexpr Fixed operator-() const { return fromRaw(-raw); }
+    constexpr Fixed& operator+=(Fixed other) { raw += other.raw; return *this; }
+    constexpr Fixed& operator-=(Fixed other) { raw -= other.raw; return *this; }
+    
+    // Multiplying and dividing by an integer keeps the format, the caller knows the range of the result
+    constexpr Fixed operator*(std::int32_t val) const { return fromRaw(raw * val); }
+    constexpr Fixed operator/(std::int32_t val) const { return fromRaw(raw / val); }
+    
+    constexpr bool operator==(Fixed other) const { return raw == other.raw; }
+    constexpr bool operator!=(Fixed other) const { return raw != other.raw; }
+    constexpr bool operator<(Fixed other) const { return raw < other.raw; }
+    constexpr bool operator<=(Fixed other) const { return raw <= other.raw; }
+    constexpr bool operator>(Fixed other) const { return raw > other.raw; }
+    constexpr bool operator>=(Fixed other) const { return raw >= other.raw; }
+    
+    // Widening multiply. The product has the fractional bits of both factors.
+    template<unsigned B, unsigned F, bool S>
+    constexpr auto operator*(Fixed<B, F, S> other) const {
+        constexpr bool SIGNED = Signed || S;
+        constexpr unsigned BITS = (Signed && S) ? Bits + B - 1 : Bits + B;
+        static_assert(BITS <= 64, "Product doesn't fit into 64 bits");
+        
+        using Result = Fixed<BITS, Frac + F, SIGNED>;
+        using Wide = typename internal::FixedStorage<(BITS <= 32 ? 32 : 64), SIGNED>::type;
+        return Result::fromRaw(static_cast<Wide>(raw) * static_cast<Wide>(other.raw));
+    }
+};
+
+} // namespace Audio
@@ -0,0 +1,372 @@
+#pragma once
+
+// Headless load test of AWSynth voices for the desktop build. Plays trigger patterns taken from games against a stand-in
+// of the audio clock, renders each audio buffer when the buffer fill interrupt would, and reports how long the buffers
+// took to render, how many missed their deadline, the theoretical note-on latency of the buffering and how many
+// sounding voices new notes cut off.
+// Nothing else may fill the LibAudio buffers meanwhile, so run it as a program of its own:
+//     int main() {
+//         Audio::AWLoadTest test;
+//         test.sfx(coin_patch, 4)                 // 0...4 triggers per frame on random channels
+//             .keyMash(bytebeat_patch, 30)        // Gates pressed or released on 30 % of the frames
+//             .tunes(arp_tune)                    // Tune on every channel
+//             .coalesce(true);                    // SFX go through AWTriggers
+//         test.run(600).print();                  // 10 minutes of simulated time
+//     }
+// Host CPUs are much faster than the Pokitto, so set deadline() to the buffer period divided by the speed difference to
+// see where the device would run out of time.
+
+#ifndef POKITTO
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <vector>
+#include <LibAudio>
+#include "AWSynthSource.h"
+#include "AWTriggers.h"
+
+namespace Audio {
+
+class AWLoadTest {
+    
+    public:
+        
+        struct Report {
+            std::uint32_t buffers = 0;
+            std::uint32_t missed = 0;           // Buffers that took longer than the deadline to render
+            std::uint32_t deadline_us = 0;
+            double render_mean_us = 0;
+            double render_p99_us = 0;
+            double render_max_us = 0;
+            double load = 0;                    // Render time per simulated time
+            
+            std::uint32_t triggers = 0;
+            std::uint32_t steals = 0;           // Triggers that cut off a held voice, or a sounding voice that another
+                                                // pattern or patch started
+            std::uint32_t merged = 0;           // SFX triggers merged or dropped by AWTriggers
+            std::uint32_t dropped = 0;
+            double trigger_mean_us = 0;         // Time spent in play(), including the low latency mix
+            double trigger_max_us = 0;
+            double latency_min_ms = 0;          // Theoretical buffer latency, from the trigger to the start of the
+                                                // first buffer the note is in. Leaves out the output stage.
+            double latency_mean_ms = 0;
+            double latency_max_ms = 0;
+            
+            void print() const {
+                std::printf("buffers: %u, missed the %u us deadline: %u\n", buffers, deadline_us, missed);
+                std::printf("render time per buffer: mean %.1f us, p99 %.1f us, max %.1f us, load %.2f %%\n",
+                            render_mean_us, render_p99_us, render_max_us, 100*load);
+                std::printf("triggers: %u, voice steals: %u, play(): mean %.1f us, max %.1f us\n",
+                            triggers, steals, trigger_mean_us, trigger_max_us);
+                std::printf("merged: %u, dropped: %u\n", merged, dropped);
+                std::printf("theoretical buffer latency: min %.1f ms, mean %.1f ms, max %.1f ms\n",
+                            latency_min_ms, latency_mean_ms, latency_max_ms);
+            }
+        };
+        
+        AWLoadTest& frameRate(std::uint32_t fps) { _fps = fps > 0 ? fps : 1; return *this; }
+        AWLoadTest& deadline(std::uint32_t us) { _deadline_us = us; return *this; }
+        AWLoadTest& seed(std::uint32_t val) { _random = val != 0 ? val : 1; return *this; }
+        
+        // Triggers 'patch' 0...'per_frame' times per frame, on random channels and 'keys' random keys from 36 up, like
+        // game SFX
+        AWLoadTest& sfx(const AWPatch& patch, std::uint32_t per_frame, std::uint32_t keys=48) {
+            _sfx.push_back({&patch, per_frame, keys > 0 ? keys : 1});
+            return *this;
+        }
+        
+        // Plays the SFX through AWTriggers, which merges and limits them with its current settings
+        AWLoadTest& coalesce(bool enabled) { _coalesce = enabled; return *this; }
+        
+        // Presses or releases the gate of each channel on 'percent' % of the frames, like the bytebeat example in main.cpp
+        AWLoadTest& keyMash(const AWPatch& patch, std::uint32_t percent) {
+            _mash = &patch;
+            _mash_percent = percent;
+            return *this;
+        }
+        
+        // Plays a SIMPLE_TUNE_AW tune with its patch on every channel, over and over. LibSchedule doesn't run headless,
+        // so the notes are stepped here with the same timing as playTuneAW().
+        template<typename Tune>
+        AWLoadTest& tunes(const Tune& tune) {
+            _tune = &tune[0];
+            _tune_length = tune.size();
+            _tune_tempo = tune.tempo();
+            _tune_patch = &tune.patch();
+            return *this;
+        }
+        
+        // Runs the patterns for 'seconds' of simulated time
+        Report run(std::uint32_t seconds) {
+            constexpr std::uint32_t RING = 512*bufferCount;
+            std::fill(audio_buffer, audio_buffer + RING, 128);
+            for(std::uint32_t idx = 0; idx < bufferCount; ++idx) {
+                audio_state[idx] = idx != 0;
+            }
+            audio_playHead = 0;
+            
+            _render_ns.clear();
+            _trigger_ns.clear();
+            _latencies.clear();
+            _steals = 0;
+            AWTriggers::resetCounts();
+            for(auto& tune : _tunes) {
+                tune = {};
+            }
+            for(auto& voice : _held) {
+                voice = nullptr;
+            }
+            for(auto& owner : _owners) {
+                owner = {};
+            }
+            
+            std::uint64_t head = 0;
+            std::uint64_t end = static_cast<std::uint64_t>(seconds) * POK_AUD_FREQ;
+            for(std::uint64_t frame = 1; head < end; ++frame) {
+                // Audio clock runs to the next frame. Every buffer that has been played is refilled.
+                std::uint64_t next = frame * POK_AUD_FREQ / _fps;
+                for(std::uint64_t boundary = (head/512 + 1) * 512; boundary <= next; boundary += 512) {
+                    fill(boundary);
+                }
+                head = next;
+                audio_playHead = head % RING;
+                AWTriggers::update();
+                
+                playTunes(head);
+                playSfx(head);
+                mashKeys(head);
+            }
+            
+            return report(seconds);
+        }
+    
+    private:
+        
+        using Clock = std::chrono::steady_clock;
+        using Play = AWSynthSource& (*)(const AWPatch& patch, std::uint8_t midikey);
+        using Coalesce = AWSynthSource* (*)(const AWPatch& patch, std::uint8_t midikey);
+        
+        // Channels the patterns play on. The effects bus, if there is one, runs on the last channel.
+        static constexpr unsigned CHANNELS = AWEffectsBus::reserves(NUM_CHANNELS-1) ? NUM_CHANNELS-1 : NUM_CHANNELS;
+        
+        // Pattern that started the note on a channel
+        enum struct Pattern : std::uint8_t { NONE, TUNE, SFX, MASH };
+        
+        struct Owner {
+            Pattern pattern;
+            const AWPatch* patch;
+        };
+        
+        struct Sfx {
+            const AWPatch* patch;
+            std::uint32_t per_frame;
+            std::uint32_t keys;
+        };
+        
+        struct TuneState {
+            std::uint32_t position;
+            std::uint64_t next;         // Sample time of the next note or rest
+            AWSynthSource* source;
+        };
+        
+        static std::uint32_t elapsed(Clock::time_point start) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        }
+        
+        // Refills the buffer that finished playing at sample time 'boundary', as the buffer fill interrupt would
+        void fill(std::uint64_t boundary) {
+            std::uint32_t playing = (boundary/512) % bufferCount;
+            std::uint32_t done = (playing - 1) & (bufferCount - 1);
+            audio_playHead = boundary % (512*bufferCount);
+            audio_state[playing] = 0;
+            
+            auto start = Clock::now();
+            AWEngine<>::getDefault().render(audio_buffer + done*512);
+            _render_ns.push_back(elapsed(start));
+            audio_state[done] = 1;
+        }
+        
+        template<bool lowLatency, unsigned... channels>
+        static AWSynthSource& play(unsigned channel, const AWPatch& patch, std::uint8_t midikey, std::integer_sequence<unsigned, channels...>) {
+            static constexpr Play TABLE[] = {&AWSynthSource::play<channels, lowLatency>...};
+            return TABLE[channel](patch, midikey);
+        }
+        
+        template<bool lowLatency, unsigned... channels>
+        static AWSynthSource* coalesce(unsigned channel, const AWPatch& patch, std::uint8_t midikey, std::integer_sequence<unsigned, channels...>) {
+            static constexpr Coalesce TABLE[] = {&AWTriggers::play<channels, lowLatency>...};
+            return TABLE[channel](patch, midikey);
+        }
+        
+        // Plays a note at sample time 'head' and records its cost and latency. A low latency note is mixed into the last
+        // filled buffer if there is one, otherwise it is heard from the next buffer that gets filled. Returns nullptr if
+        // AWTriggers dropped the note. A pattern that plays over a released voice of its own doesn't steal it.
+        template<bool lowLatency>
+        AWSynthSource* trigger(Pattern pattern, unsigned channel, const AWPatch& patch, std::uint8_t midikey, std::uint64_t head,
+                               bool coalesced=false) {
+            constexpr auto SEQUENCE = std::make_integer_sequence<unsigned, CHANNELS>();
+            std::uint32_t playing = (head/512) % bufferCount;
+            bool mixed = lowLatency && audio_state[(playing - 1) & (bufferCount - 1)];
+            
+            auto& engine = AWEngine<>::getDefault();
+            const auto& owner = _owners[channel];
+            bool stolen = engine.isPlaying(channel) &&
+                          (!engine.voice(channel)._released || owner.pattern != pattern || owner.patch != &patch);
+            std::uint32_t merged = AWTriggers::merged();
+            
+            auto start = Clock::now();
+            auto* voice = coalesced ? coalesce<lowLatency>(channel, patch, midikey, SEQUENCE)
+                                    : &play<lowLatency>(channel, patch, midikey, SEQUENCE);
+            _trigger_ns.push_back(elapsed(start));
+            
+            if(voice == nullptr || AWTriggers::merged() != merged) {
+                return voice;   // No note was started
+            }
+            _steals += stolen;
+            _owners[channel] = {pattern, &patch};
+            std::uint64_t first = (head/512 + bufferCount - (mixed ? 1 : 0)) * 512;
+            _latencies.push_back(first - head);
+            return voice;
+        }
+        
+        void playTunes(std::uint64_t head) {
+            if(_tune == nullptr) {
+                return;
+            }
+            
+            for(unsigned channel = 0; channel < CHANNELS; ++channel) {
+                auto& tune = _tunes[channel];
+                while(tune.next <= head) {
+                    if(tune.position >= _tune_length) {
+                        if(tune.source) {
+                            tune.source->release();
+                        }
+                        tune.position = 0;      // Starts over
+                    }
+                    
+                    std::uint32_t note = _tune[tune.position] & 0x7F;
+                    std::int8_t length = _tune[tune.position+1];
+                    tune.position += 2;
+                    
+                    if(note <= 88) {
+                        tune.source = trigger<false>(Pattern::TUNE, channel, *_tune_patch, 23+note, head);
+                    }
+                    else if(tune.source) {
+                        tune.source->release();
+                    }
+                    
+                    std::uint32_t ms = length < 0 ? _tune_tempo / -length : (length > 0 ? _tune_tempo * length : _tune_tempo);
+                    tune.next += (ms > 0 ? ms : 1) * POK_AUD_FREQ / 1000;
+                }
+            }
+        }
+        
+        void playSfx(std::uint64_t head) {
+            for(auto& sfx : _sfx) {
+                for(std::uint32_t count = random() % (sfx.per_frame + 1); count > 0; --count) {
+                    trigger<true>(Pattern::SFX, random() % CHANNELS, *sfx.patch, 36 + random() % sfx.keys, head, _coalesce);
+                }
+            }
+        }
+        
+        void mashKeys(std::uint64_t head) {
+            if(_mash == nullptr) {
+                return;
+            }
+            
+            for(unsigned channel = 0; channel < CHANNELS; ++channel) {
+                if(random() % 100 >= _mash_percent) {
+                    continue;
+                }
+                if(_held[channel]) {
+                    _held[channel]->release();
+                    _held[channel] = nullptr;
+                }
+                else {
+                    _held[channel] = trigger<true>(Pattern::MASH, channel, *_mash, 48, head);
+                }
+            }
+        }
+        
+        Report report(std::uint32_t seconds) const {
+            Report result;
+            result.deadline_us = _deadline_us;
+            result.buffers = _render_ns.size();
+            result.triggers = _trigger_ns.size();
+            result.steals = _steals;
+            result.merged = AWTriggers::merged();
+            result.dropped = AWTriggers::dropped();
+            
+            double total_ns = 0;
+            for(auto ns : _render_ns) {
+                total_ns += ns;
+                result.missed += ns > _deadline_us*1000ull;
+            }
+            if(!_render_ns.empty()) {
+                std::vector<std::uint32_t> sorted = _render_ns;
+                std::sort(sorted.begin(), sorted.end());
+                result.render_mean_us = total_ns / sorted.size() / 1000;
+                result.render_p99_us = sorted[sorted.size()*99/100] / 1000.0;
+                result.render_max_us = sorted.back() / 1000.0;
+                result.load = total_ns / (seconds * 1e9);
+            }
+            
+            if(!_trigger_ns.empty()) {
+                double sum = 0;
+                for(auto ns : _trigger_ns) {
+                    sum += ns;
+                }
+                result.trigger_mean_us = sum / _trigger_ns.size() / 1000;
+                result.trigger_max_us = *std::max_element(_trigger_ns.begin(), _trigger_ns.end()) / 1000.0;
+            }
+            
+            if(!_latencies.empty()) {
+                double latency = 0;
+                for(auto samples : _latencies) {
+                    latency += samples;
+                }
+                constexpr double MS = 1000.0 / POK_AUD_FREQ;
+                result.latency_mean_ms = latency / _latencies.size() * MS;
+                result.latency_min_ms = *std::min_element(_latencies.begin(), _latencies.end()) * MS;
+                result.latency_max_ms = *std::max_element(_latencies.begin(), _latencies.end()) * MS;
+            }
+            return result;
+        }
+        
+        // Xorshift, so that runs are repeatable
+        std::uint32_t random() {
+            _random ^= _random << 13;
+            _random ^= _random >> 17;
+            _random ^= _random << 5;
+            return _random;
+        }
+        
+        std::uint32_t _fps = 60;
+        std::uint32_t _deadline_us = 512 * 1000000ull / POK_AUD_FREQ;
+        std::uint32_t _random = 1;
+        
+        std::vector<Sfx> _sfx;
+        bool _coalesce = false;
+        const AWPatch* _mash = nullptr;
+        std::uint32_t _mash_percent = 0;
+        AWSynthSource* _held[NUM_CHANNELS] = {};
+        Owner _owners[NUM_CHANNELS] = {};
+        
+        const std::uint8_t* _tune = nullptr;
+        std::uint32_t _tune_length = 0;
+        std::uint32_t _tune_tempo = 0;
+        const AWPatch* _tune_patch = nullptr;
+        TuneState _tunes[NUM_CHANNELS] = {};
+        
+        std::vector<std::uint32_t> _render_ns;
+        std::vector<std::uint32_t> _trigger_ns;
+        std::vector<std::uint32_t> _latencies;
+        std::uint32_t _steals = 0;
+};
+
+} // namespace Audio
+
+#endif
@@ -0,0 +1,356 @@
+#pragma once
+
+// Live reloading of .awpatch files in the desktop build. A watcher loads the file into an AWPatch and reloads it when
+// the file changes, e.g. when it's saved in the patch editor. Voices that are playing the old version switch to the
+// new one at their next control value update, so sounds can be tuned without rebuilding or stopping audio.
+// Requires PROJ_AWSYNTH_HOTSWAP. Usage:
+//     static Audio::AWPatchWatcher jump("sounds/jump.awpatch");
+//     jump.poll();                                     // Once per frame
+//     Audio::AWSynthSource::play<1>(jump.patch());
+
+#ifndef POKITTO
+
+#ifndef PROJ_AWSYNTH_HOTSWAP
+#error "AWPatchWatcher.h requires PROJ_AWSYNTH_HOTSWAP"
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include "AWSynthSource.h"
+
+namespace Audio {
+
+// Patch loaded from an .awpatch file. The waveform can change at every envelope step, like in the patches created by
+// ConvertAWPatches.js.
+class AWLoadedPatch {
+    
+    public:
+        
+        AWLoadedPatch() : _patch(callback, *this) {}
+        
+        AWLoadedPatch(const AWLoadedPatch&) = delete;
+        AWLoadedPatch& operator=(const AWLoadedPatch&) = delete;
+        
+        const AWPatch& patch() const { return _patch; }
+        
+        // Key that couldn't be parsed by the last parse(), or an empty string if it succeeded
+        const std::string& error() const { return _error; }
+        
+        // Parses the JSON text of an .awpatch file. Returns false and leaves the patch unchanged if it can't be parsed,
+        // and error() tells which key was wrong.
+        bool parse(const std::string& text) {
+            std::int32_t volume, step, release, glide;
+            if(!number(text, "volume", volume) || !number(text, "step", step) ||
+               !number(text, "release", release) || !number(text, "glide", glide)) {
+                return false;
+            }
+            
+            Wave waves[AWPatch::Envelope::SIZE];
+            std::string waveform = value(text, "waveform");
+            _error = "waveform";
+            if(waveform.empty()) {
+                return false;
+            }
+            else if(waveform[0] == '[') {
+                std::uint32_t count = 0;
+                for(std::size_t pos = 0; (pos = waveform.find('"', pos)) != std::string::npos && count < AWPatch::Envelope::SIZE; ) {
+                    std::size_t end = waveform.find('"', pos+1);
+                    if(end == std::string::npos || !(waves[count++] = wave(waveform.substr(pos+1, end-pos-1)))) {
+                        return false;
+                    }
+                    pos = end + 1;
+                }
+                if(count != AWPatch::Envelope::SIZE) {
+                    return false;
+                }
+            }
+            else {
+                Wave single = wave(waveform.substr(1, waveform.size()-2));
+                if(!single) {
+                    return false;
+                }
+                for(auto& item : waves) {
+                    item = single;
+                }
+            }
+            
+            _error.clear();
+            std::uint8_t amplitude_loop, amplitude_length, semitone_loop, semitone_length;
+            std::string amplitudes = value(text, "amplitudes");
+            std::string semitones = value(text, "semitones");
+            AWPatch::Envelope amplitude_env = envelope(amplitudes, true, amplitude_loop, amplitude_length);
+            if(amplitude_length == 0) {
+                _error = _error.empty() ? "amplitudes" : "amplitudes." + _error;
+                return false;
+            }
+            AWPatch::Envelope semitone_env = envelope(semitones, false, semitone_loop, semitone_length);
+            if(semitone_length == 0) {
+                _error = _error.empty() ? "semitones" : "semitones." + _error;
+                return false;
+            }
+            
+            for(std::uint32_t idx = 0; idx < AWPatch::Envelope::SIZE; ++idx) {
+                _waves[idx] = waves[idx];
+            }
+            _length = amplitude_length;
+            _loop = amplitude_loop;
+            
+            _patch.volume(volume).step(step).release(release).glide(glide)
+                .amplitudes(amplitude_env.loop(amplitude_loop, amplitude_length))
+                .semitones(semitone_env.loop(semitone_loop, semitone_length));
+            return true;
+        }
+    
+    private:
+        
+        using Wave = std::int32_t (*)(std::uint32_t p);
+        
+        // Picks the waveform of the current envelope step, the same way as the patches converted to C++
+        static std::int32_t callback(std::uint32_t t, std::uint32_t p, void* data) {
+            auto& self = *reinterpret_cast<AWLoadedPatch*>(data);
+            std::uint32_t step = t>>8;
+            std::uint32_t len = self._length;
+            std::uint32_t loop = self._loop;
+            std::uint32_t idx = (step < len) ? step : ((loop < len) ? loop + step%(len-loop) : len-1);
+            Wave wave = self._waves[idx < AWPatch::Envelope::SIZE ? idx : AWPatch::Envelope::SIZE-1];
+            return wave ? wave(p) : 0;
+        }
+        
+        static std::int32_t pulse(std::uint32_t p) { return AWSynthSource::sqr(p, 79); }
+        static std::int32_t square(std::uint32_t p) { return AWSynthSource::sqr(p); }
+        
+        static Wave wave(const std::string& name) {
+            if(name == "square") return square;
+            if(name == "pulse") return pulse;
+            if(name == "sawtooth") return AWSynthSource::saw;
+            if(name == "softsaw") return AWSynthSource::saw<32>;
+            if(name == "triangle") return AWSynthSource::tri;
+            if(name == "sine") return AWSynthSource::sin;
+            if(name == "noise") return AWSynthSource::noise;
+            return nullptr;
+        }
+        
+        // Returns the JSON value of 'key' as text: a number, a quoted string, or an array or object with its brackets.
+        // Only keys of the object 'text' itself match, not strings in values or keys of nested objects.
+        static std::string value(const std::string& text, const char* key) {
+            std::string name = std::string("\"") + key + "\"";
+            std::size_t pos = std::string::npos;
+            std::int32_t depth = 0;
+            for(std::size_t idx = 0; idx < text.size() && pos == std::string::npos; ++idx) {
+                char c = text[idx];
+                if(c == '"') {
+                    std::size_t end = text.find('"', idx+1);
+                    if(end == std::string::npos) {
+                        return "";
+                    }
+                    std::size_t colon = text.find_first_not_of(" \t\r\n", end+1);
+                    if(depth == 1 && colon != std::string::npos && text[colon] == ':' && text.compare(idx, end-idx+1, name) == 0) {
+                        pos = colon;
+                    }
+                    idx = end;
+                }
+                else if(c == '[' || c == '{') {
+                    ++depth;
+                }
+                else if(c == ']' || c == '}') {
+                    --depth;
+                }
+            }
+            if(pos == std::string::npos) {
+                return "";
+            }
+            pos = text.find_first_not_of(" \t\r\n", pos+1);
+            if(pos == std::string::npos) {
+                return "";
+            }
+            
+            std::size_t end = pos;
+            if(text[pos] == '[' || text[pos] == '{') {
+                std::int32_t depth = 0;
+                bool quoted = false;
+                for(; end < text.size(); ++end) {
+                    char c = text[end];
+                    if(c == '"') quoted = !quoted;
+                    if(quoted) continue;
+                    if(c == '[' || c == '{') ++depth;
+                    if((c == ']' || c == '}') && --depth == 0) break;
+                }
+                return end < text.size() ? text.substr(pos, end-pos+1) : "";
+            }
+            else if(text[pos] == '"') {
+                end = text.find('"', pos+1);
+                return end != std::string::npos ? text.substr(pos, end-pos+1) : "";
+            }
+            end = text.find_first_of(",}] \t\r\n", pos);
+            return text.substr(pos, end-pos);
+        }
+        
+        // Parses a whole number. The patch editor saves some numbers as strings, e.g. "step":"3", which JSON.parse() and
+        // ConvertAWPatches.js accept as well. Sets the error to 'key' if it fails.
+        bool number(const std::string& text, const char* key, std::int32_t& out) {
+            std::string val = value(text, key);
+            if(val.size() >= 2 && val.front() == '"' && val.back() == '"') {
+                val = val.substr(1, val.size()-2);
+            }
+            
+            char* end = nullptr;
+            out = std::strtol(val.c_str(), &end, 10);
+            if(val.empty() || *end != '\0') {
+                _error = key;
+                return false;
+            }
+            return true;
+        }
+        
+        // Parses an envelope object. Amplitudes given in percent are scaled to 0...31 like in ConvertAWPatches.js.
+        AWPatch::Envelope envelope(const std::string& obj, bool amplitudes, std::uint8_t& loop, std::uint8_t& length) {
+            std::int8_t data[AWPatch::Envelope::SIZE] = {};
+            std::int32_t items[AWPatch::Envelope::SIZE] = {};
+            std::int32_t loop_start = 0;
+            std::int32_t len = 0;
+            length = 0;
+            loop = 0;
+            
+            std::string list = value(obj, "data");
+            if(obj.empty() || list.empty() || !number(obj, "loop_start", loop_start) || !number(obj, "length", len)) {
+                return AWPatch::Envelope(data);
+            }
+            
+            bool percent = false;
+            const char* str = list.c_str() + 1;
+            for(std::uint32_t idx = 0; idx < AWPatch::Envelope::SIZE && *str; ++idx) {
+                char* end = nullptr;
+                items[idx] = std::strtol(str, &end, 10);
+                percent |= items[idx] > 32;
+                str = end + std::strspn(end, ", \t\r\n");
+            }
+            for(std::uint32_t idx = 0; idx < AWPatch::Envelope::SIZE; ++idx) {
+                data[idx] = (amplitudes && percent) ? items[idx]*31/100 : items[idx];
+            }
+            
+            AWPatch::Envelope env(data);
+            std::string smooth = value(obj, "smooth");
+            std::string effects = value(obj, "effects");
+            if(!smooth.empty()) {
+                env.smooth(smooth == "true");
+            }
+            else if(!effects.empty()) {
+                static const char* const NAMES[] = {"\"step\"", "\"attack\"", "\"decay\"", "\"slide\""};
+                std::size_t pos = 0;
+                for(std::uint32_t idx = 0; idx < AWPatch::Envelope::SIZE; ++idx) {
+                    pos = effects.find('"', pos);
+                    if(pos == std::string::npos) break;
+                    std::size_t end = effects.find('"', pos+1);
+                    std::string name = effects.substr(pos, end-pos+1);
+                    for(std::uint8_t effect = 0; effect < 4; ++effect) {
+                        if(name == NAMES[effect]) {
+                            env._data[idx] = (env._data[idx]&(-4)) | effect;
+                        }
+                    }
+                    pos = end + 1;
+                }
+            }
+            
+            loop = loop_start;
+            length = len;
+            return env;
+        }
+        
+        AWPatch _patch;
+        Wave _waves[AWPatch::Envelope::SIZE] = {};
+        std::uint8_t _length = 1;
+        std::uint8_t _loop = 0;
+        std::string _error;
+};
+
+// Watches an .awpatch file and reloads it when it changes
+class AWPatchWatcher {
+    
+    public:
+        
+        explicit AWPatchWatcher(const char* path) : _path(path) { poll(); }
+        
+        // Patch with the latest loaded version of the file
+        const AWPatch& patch() const { return _slots[_active].patch(); }
+        
+        // Key of the file that couldn't be parsed, or an empty string if the last version was loaded
+        const std::string& error() const { return _error; }
+        
+        // Checks if the file has changed and reloads it. Call regularly from the main loop, not from the audio
+        // interrupt. Returns true if a new version was taken into use.
+        bool poll() {
+            struct stat info;
+            if(stat(_path.c_str(), &info) != 0) {
+                return false;
+            }
+            if(_loaded && info.st_mtime == _mtime && info.st_size == _size) {
+                return false;
+            }
+            
+            // The other slot is reused only after every voice has stopped playing it
+            AWLoadedPatch& next = _slots[_active ^ 1];
+            if(_loaded && AWSynthSource::isPlaying(next.patch())) {
+                return false;
+            }
+            
+            std::string text;
+            if(!read(text)) {
+                return false;
+            }
+            if(!next.parse(text)) {
+                // The file may be half written, so try again later, but report each version only once
+                if(next.error() != _error || info.st_mtime != _failed_mtime || info.st_size != _failed_size) {
+                    std::fprintf(stderr, "AWPatchWatcher: %s: can't parse \"%s\"\n", _path.c_str(), next.error().c_str());
+                }
+                _error = next.error();
+                _failed_mtime = info.st_mtime;
+                _failed_size = info.st_size;
+                return false;
+            }
+            
+            _error.clear();
+            _mtime = info.st_mtime;
+            _size = info.st_size;
+            if(_loaded) {
+                AWSynthSource::hotSwap(_slots[_active].patch(), next.patch());
+            }
+            _active ^= 1;
+            _loaded = true;
+            return true;
+        }
+    
+    private:
+        
+        bool read(std::string& text) const {
+            std::FILE* file = std::fopen(_path.c_str(), "rb");
+            if(!file) {
+                return false;
+            }
+            char buffer[512];
+            for(std::size_t count; (count = std::fread(buffer, 1, sizeof(buffer), file)) > 0; ) {
+                text.append(buffer, count);
+            }
+            std::fclose(file);
+            return true;
+        }
+        
+        std::string _path;
+        AWLoadedPatch _slots[2];
+        std::uint32_t _active = 0;
+        bool _loaded = false;
+        time_t _mtime = 0;
+        off_t _size = 0;
+        
+        // Last version that failed to parse
+        std::string _error;
+        time_t _failed_mtime = 0;
+        off_t _failed_size = 0;
+};
+
+} // namespace Audio
+
+#endif
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <LibAudio>
+#include "AWSynthSource.h"
+
+// Render-ahead voices. A voice played with AWRenderAhead<channel>::play() is rendered into blocks of its own whenever
+// renderAhead() is called from the main loop, and the audio buffer fill only copies or mixes a finished block. This
+// moves the synthesis out of the buffer fill and smooths the CPU load. Every block keeps a checkpoint of the voice
+// state at its end. play(), release() and send() drop the blocks that haven't been played yet and continue from the
+// last played checkpoint, so changes are heard as soon as without rendering ahead. Usage:
+//     Audio::AWRenderAhead<1>::play(patch, 60);
+//     Audio::AWRenderAhead<1>::renderAhead();     // In the main loop, e.g. once per frame
+// A channel should be played either through AWRenderAhead or through AWSynthSource, not both. Plucked voices are
+// always rendered on request, as their delay lines can't be restored from a checkpoint.
+
+#ifdef PROJ_AWSYNTH_HOTSWAP
+#error "AWRenderAhead.h can't be used with PROJ_AWSYNTH_HOTSWAP"
+#endif
+
+namespace Audio {
+
+// 'Blocks' is the number of 512 sample blocks rendered ahead at most. Each one takes 512 bytes and a copy of the voice.
+template<std::uint32_t channel, std::uint32_t Blocks=1>
+class AWRenderAhead {
+    
+    static_assert(Blocks > 0 && Blocks < bufferCount, "Blocks must be between 1 and bufferCount-1");
+    static_assert(!AWEffectsBus::reserves(channel), "Channel is used by the effects bus");
+    
+    public:
+        
+        static AWRenderAhead& getInstance() {
+            static AWRenderAhead self;
+            return self;
+        }
+        
+        template<bool lowLatency=true>
+        static AWRenderAhead& play(const AWPatch& patch, std::uint8_t midikey=48) {
+            AWSYNTH_TRACE(PLAY, channel, audio_playHead);
+            
+            auto& self = getInstance();
+            auto& voice = self._voice;
+            self.invalidate();
+            voice._channel = channel;
+            voice.init(patch, midikey);
+            AWSYNTH_TRACE(INIT, channel, 0);
+            
+            using Generator = AWSynthSource::Generator;
+            self._ahead = true;
+            switch(voice.select(patch)) {
+                case Generator::FM:
+                    self._render = render<Generator::FM>;
+                    break;
+                
+                case Generator::PLUCK:
+                    self._render = render<Generator::PLUCK>;
+                    self._ahead = false;
+                    break;
+                
+                case Generator::WITH_DATA:
+                    self._render = render<Generator::WITH_DATA>;
+                    break;
+                
+                default:
+                    self._render = render<Generator::PLAIN>;
+                    break;
+            }
+            
+            if(lowLatency) {
+                // Check if the last audio buffer has already been filled, and if so, add to it without sending
+                std::uint32_t idx = audio_playHead >> 9;
+                std::uint32_t last = (idx - 1) & (bufferCount - 1);
+                if(audio_state[last]) {
+                    self._render(voice, audio_buffer + last*512, true, false);
+                }
+            }
+            
+            self._playing = true;
+            Audio::connect(channel, &self, process);
+            return self;
+        }
+        
+        inline void release() {
+            invalidate();
+            _voice.release();
+        }
+        
+        inline void send(std::uint8_t val) {
+            invalidate();
+            _voice.send(val);
+        }
+        
+        // Renders blocks for the buffers that are free in audio_buffer and will be requested next, or at least for the
+        // next one. Call from the main loop, not from the audio interrupt. Returns the number of blocks rendered.
+        static std::uint32_t renderAhead() {
+            auto& self = getInstance();
+            
+            std::uint32_t free = 0;
+            for(std::uint32_t idx = 0; idx < bufferCount; ++idx) {
+                free += audio_state[idx] == 0;
+            }
+            free = free > 0 ? (free < Blocks ? free : Blocks) : 1;
+            
+            std::uint32_t count = 0;
+            while(self._playing && self._ahead && self._produced - self._consumed < free) {
+                if(!self.renderBlock()) {
+                    break;
+                }
+                ++count;
+            }
+            return count;
+        }
+    
+    private:
+        
+        using Render = bool (*)(AWSynthSource& voice, std::uint8_t* buffer, bool mixing, bool sending);
+        
+        template<AWSynthSource::Generator generator>
+        static bool render(AWSynthSource& voice, std::uint8_t* buffer, bool mixing, bool sending) {
+            return voice.template renderLoop<generator>(buffer, mixing, sending);
+        }
+        
+        // Copies the voice state. Per-voice state passed to the callback must point to the copy's own state slot.
+        static void copyVoice(AWSynthSource& dst, const AWSynthSource& src) {
+            dst = src;
+            if(src._data == static_cast<const void*>(src._state)) {
+                dst._data = dst._state;
+            }
+        }
+        
+        // Drops the blocks that haven't been played. The voice itself is always at the start of the next buffer.
+        inline void invalidate() {
+            std::uint32_t consumed;
+            do {
+                consumed = _consumed;
+                _produced = consumed;
+            } while(consumed != _consumed);     // A block was played in between
+        }
+        
+        // Renders the block after the last one into a new checkpoint. Blocks are produced here and played in the audio
+        // interrupt, so each counter has only one writer. If the voice was rendered on request meanwhile, the block
+        // doesn't follow it any more and is thrown away.
+        bool renderBlock() {
+            std::uint32_t produced = _produced;
+            std::uint32_t seq = _seq;
+            std::uint32_t idx = produced % Blocks;
+            std::uint32_t prev = (produced - 1) % Blocks;
+            
+            if(produced == _consumed) {
+                copyVoice(_checkpoints[idx], _voice);
+            }
+            else if(_retired[prev]) {
+                return false;   // Voice fades out in the previous block
+            }
+            else {
+                copyVoice(_checkpoints[idx], _checkpoints[prev]);
+            }
+            
+            _retired[idx] = !_render(_checkpoints[idx], _blocks[idx], false, false);
+            
+            if(seq != _seq) {
+                return false;
+            }
+            _produced = produced + 1;
+            return true;
+        }
+        
+        static void process(std::uint8_t* buffer, void* ptr) {
+            auto& self = *reinterpret_cast<AWRenderAhead*>(ptr);
+            AWSYNTH_TRACE(FILL_START, channel, audio_playHead);
+            
+            bool playing;
+            std::uint32_t consumed = self._consumed;
+            if(self._produced != consumed) {
+                std::uint32_t idx = consumed % Blocks;
+                const std::uint8_t* block = self._blocks[idx];
+                std::int16_t* send = self._voice._send_Q8 > 0 ? AWEffectsBus::sendBuffer() : nullptr;
+                
+                for(std::uint32_t i = 0; i < 512; ++i) {
+                    buffer[i] = channel == 0 ? block[i] : Audio::mix(buffer[i], block[i]);
+                    if(send) {
+                        send[i] += ((block[i]-128)*self._voice._send_Q8) >> 8;
+                    }
+                }
+                
+                copyVoice(self._voice, self._checkpoints[idx]);
+                playing = !self._retired[idx];
+                self._consumed = consumed + 1;
+            }
+            else {
+                playing = self._render(self._voice, buffer, channel != 0, true);
+                ++self._seq;
+            }
+            
+            if(!playing) {
+                AWSYNTH_TRACE(STOP, channel, 0);
+                self._playing = false;
+                Audio::stop<channel>();
+            }
+            AWSYNTH_TRACE(FILL_END, channel, audio_playHead);
+        }
+        
+        AWSynthSource _voice;
+        Render _render = nullptr;
+        bool _ahead = false;
+        volatile bool _playing = false;
+        
+        // Counters of blocks rendered ahead and played, and of buffers rendered on request
+        volatile std::uint32_t _produced = 0;
+        volatile std::uint32_t _consumed = 0;
+        volatile std::uint32_t _seq = 0;
+        
+        AWSynthSource _checkpoints[Blocks];
+        bool _retired[Blocks] = {};
+        std::uint8_t _blocks[Blocks][512];
+};
+
+} // namespace Audio
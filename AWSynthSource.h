@@ -1,25 +1,336 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <LibAudio>
+#include "AWEffectsBus.h"
+#include "AWFixed.h"
+#include "AWTrace.h"
+
+#ifdef PROJ_AWSYNTH_HOTSWAP
+#include <atomic>
+#endif
+
+// Size of the per-voice state slot in bytes. Every voice reserves this much RAM for stateful patches.
+#ifndef PROJ_AWSYNTH_VOICE_STATE_SIZE
+#define PROJ_AWSYNTH_VOICE_STATE_SIZE 48
+#endif
+
+// Size of the delay line pool shared by plucked string voices in bytes
+#ifndef PROJ_AWSYNTH_PLUCK_POOL_SIZE
+#define PROJ_AWSYNTH_PLUCK_POOL_SIZE 512
+#endif
 
 namespace Audio {
 
+// Operator of the built-in FM voice (see AWFMSynth.h). Pitch ratio and level are converted to fixed point at compile
+// time. Level is 0...100 %: for carriers it is the output gain, for modulators the modulation depth on the same scale
+// as in the FM Synth program. Operator envelope rises from zero to full level in 'attack' milliseconds, and then falls
+// to 'sustain' level (0...100 %) in 'decay' milliseconds.
+struct AWFMOperator {
+    constexpr AWFMOperator(double ratio, std::uint8_t level, std::uint16_t attack=0, std::uint16_t decay=0, std::uint8_t sustain=100) :
+        _ratio_Q8(ratio*256 + 0.5),
+        _output_Q10(((level < 100 ? level : 100) << 10) / 100),
+        _depth_Q10(depth(level < 100 ? level : 100)),
+        _attack_rate_Q16(rate(1<<16, attack)),
+        _decay_rate_Q16(rate((1<<16) - sustainLevel(sustain), decay)),
+        _sustain_Q16(sustainLevel(sustain))
+    {
+    }
+    
+    std::uint16_t _ratio_Q8;
+    std::int16_t _output_Q10;
+    std::int16_t _depth_Q10;
+    std::int32_t _attack_rate_Q16;
+    std::int32_t _decay_rate_Q16;
+    std::int32_t _sustain_Q16;
+    
+    // Envelopes are evaluated at the control rate of AWSynthSource
+    static constexpr std::uint32_t CONTROL_RATE = 240;
+    
+    // Same curve as the FM Synth program, level 100 % gives a peak phase deviation of 4.5 periods
+    static constexpr std::int32_t depth(std::int32_t level) {
+        constexpr std::int32_t PERCENT_Q15 = 0.01 * (1<<15);
+        std::int32_t lvl_Q15 = level * PERCENT_Q15;
+        return 9 * ((lvl_Q15*lvl_Q15) >> (1+5+15));
+    }
+    
+    static constexpr std::int32_t sustainLevel(std::uint8_t sustain) {
+        return ((sustain < 100 ? sustain : 100) << 16) / 100;
+    }
+    
+    // Envelope increment per control value update to cover 'range' in 'ms' milliseconds
+    static constexpr std::int32_t rate(std::int32_t range, std::uint32_t ms) {
+        std::uint32_t updates = ms * CONTROL_RATE / 1000;
+        return updates > 0 ? (range + updates - 1) / updates : (1<<16);
+    }
+};
+
+// Per-voice state of the FM operators. Every voice has its own copy, so the same FM patch can be played on several
+// channels at once.
+struct AWFMState {
+    static constexpr std::uint32_t MAX_OPERATORS = 4;
+    
+    enum struct Stage : std::uint8_t { ATTACK=0, DECAY=1, SUSTAIN=2 };
+    
+    const AWFMOperator* operators = nullptr;
+    std::int32_t feedback = 0;
+    std::int32_t env_Q16[MAX_OPERATORS] = {};
+    std::int16_t gain_Q10[MAX_OPERATORS] = {};
+    std::int16_t feedback_gain_Q10 = 0;
+    Stage stage[MAX_OPERATORS] = {};
+    std::uint8_t count = 0;
+    std::uint8_t carriers = 0;
+    
+    inline void init(const AWFMOperator* ops, std::uint8_t num_ops, std::uint8_t carrier_mask, std::int16_t feedback_Q10) {
+        operators = ops;
+        count = num_ops;
+        carriers = carrier_mask;
+        feedback_gain_Q10 = feedback_Q10;
+        feedback = 0;
+        for(std::uint32_t idx = 0; idx < count; ++idx) {
+            env_Q16[idx] = 0;
+            stage[idx] = Stage::ATTACK;
+        }
+        update();
+    }
+    
+    // Advances operator envelopes by one control value update
+    inline void update() {
+        for(std::uint32_t idx = 0; idx < count; ++idx) {
+            const AWFMOperator& op = operators[idx];
+            std::int32_t env_Q16_ = env_Q16[idx];
+            
+            switch(stage[idx]) {
+                case Stage::ATTACK:
+                    env_Q16_ += op._attack_rate_Q16;
+                    if(env_Q16_ >= (1<<16)) {
+                        env_Q16_ = 1<<16;
+                        stage[idx] = Stage::DECAY;
+                    }
+                    break;
+                
+                case Stage::DECAY:
+                    env_Q16_ -= op._decay_rate_Q16;
+                    if(env_Q16_ <= op._sustain_Q16) {
+                        env_Q16_ = op._sustain_Q16;
+                        stage[idx] = Stage::SUSTAIN;
+                    }
+                    break;
+                
+                default:
+                    break;
+            }
+            env_Q16[idx] = env_Q16_;
+            
+            // Squared envelope gives nicer result
+            std::int32_t env_Q14 = env_Q16_ >> 2;
+            std::int32_t level_Q10 = (carriers & (1<<idx)) ? op._output_Q10 : op._depth_Q10;
+            gain_Q10[idx] = (level_Q10 * ((env_Q14*env_Q14) >> 14)) >> 14;
+        }
+    }
+};
+
+// Renders one sample of an FM voice from phase 'p'. Instantiated per routing algorithm by AWFMSynth.h.
+using AWFMRender = std::int32_t (*)(AWFMState& state, std::uint32_t p);
+
+// Per-voice state of the plucked string voice (Karplus-Strong). The delay line holds one period of the string, read at
+// the pitch of the voice. Every entry is averaged with the next one as the read position passes it, so high harmonics
+// die out faster than the fundamental. Delay lines are taken from a pool shared by all voices, which is only linked in
+// if a plucked patch is used.
+struct AWPluckState {
+    static constexpr std::uint32_t MIN_LENGTH = 4;
+    static constexpr std::uint32_t MAX_LENGTH = 256;
+    static constexpr std::uint32_t POOL_SIZE = PROJ_AWSYNTH_PLUCK_POOL_SIZE;
+    static_assert(POOL_SIZE >= MIN_LENGTH, "PROJ_AWSYNTH_PLUCK_POOL_SIZE is too small");
+    
+    // Part of the pool used by a voice. Owner is null when the block is free.
+    struct Block {
+        const void* owner;
+        std::uint16_t start;
+        std::uint16_t length;
+    };
+    
+    std::int8_t* buffer = nullptr;
+    Block* block = nullptr;
+    std::uint8_t shift = 8;
+    std::uint8_t pos = 0;
+    
+    // Takes a delay line for 'owner' and fills it with noise. Defined after AWSynthSource, whose noise() it uses. Length
+    // is the power of two nearest to one period at 'rate_Q24', or shorter if the pool is running out, which only makes
+    // the string decay faster.
+    static void init(void* slot, const void* owner, std::uint32_t rate_Q24);
+    
+    // Returns the delay line entry at phase 'p', averaging the previous entry with it when the read position moves on
+    inline std::int32_t render(std::uint32_t p) {
+        std::uint32_t idx = (p&255) >> shift;
+        if(idx != pos) {
+            std::int32_t sum = buffer[pos] + buffer[idx];
+            buffer[pos] = (sum - (sum>>31)) >> 1;   // Rounds toward zero, so the string dies out instead of drifting
+            pos = idx;
+        }
+        return buffer[idx];
+    }
+    
+    // Gives the delay line back to the pool. Called when the voice has faded out or starts another note.
+    inline void free() {
+        if(block != nullptr) {
+            block->owner = nullptr;
+            block = nullptr;
+        }
+        buffer = &_silence;
+        shift = 8;
+        pos = 0;
+    }
+    
+    private:
+        
+        // First fit. Blocks are allocated in the main loop and freed in the audio interrupt, which can only make
+        // more room, so a block that is seen as used is simply skipped.
+        static Block* allocate(const void* owner, std::uint32_t length) {
+            Block* entry = nullptr;
+            for(auto& block : _blocks) {
+                if(block.owner == nullptr && entry == nullptr) {
+                    entry = &block;
+                }
+            }
+            if(entry == nullptr) {
+                return nullptr;
+            }
+            
+            std::uint32_t start = 0;
+            for(bool moved = true; moved && start + length <= POOL_SIZE; ) {
+                moved = false;
+                for(auto& block : _blocks) {
+                    if(block.owner != nullptr && start < block.start + block.length && block.start < start + length) {
+                        start = block.start + block.length;
+                        moved = true;
+                    }
+                }
+            }
+            if(start + length > POOL_SIZE) {
+                return nullptr;
+            }
+            
+            entry->start = start;
+            entry->length = length;
+            entry->owner = owner;
+            return entry;
+        }
+        
+        static inline std::int8_t _pool[POOL_SIZE] = {};
+        static inline Block _blocks[NUM_CHANNELS] = {};
+        static inline std::int8_t _silence = 0;
+        static inline std::uint32_t _seed = 0;
+};
+
+class AWSynthSource;
+
 struct AWPatch {
-    constexpr AWPatch(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p)) : _callback(callback), _data(nullptr) {}
+    // Source of the samples: callback without or with user data, built-in FM voice or plucked string
+    enum struct Generator { PLAIN, WITH_DATA, FM, PLUCK };
+    
+    constexpr AWPatch(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p)) : _callback(callback), _data(nullptr), _start(start<Generator::PLAIN>) {}
     
     template<typename T>
-    constexpr AWPatch(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p, void* data), T& obj) : _callback_with_data(callback), _data(reinterpret_cast<void*>(&obj)) {}
+    constexpr AWPatch(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p, void* data), T& obj) :
+        _callback_with_data(callback), _data(reinterpret_cast<void*>(&obj)), _start(start<Generator::WITH_DATA>)
+    {
+    }
+    
+    // FM voice with operators rendered by 'render'. 'carriers' has a bit set for each operator that is a carrier.
+    // Use AWFM::patch() in AWFMSynth.h instead of calling this directly.
+    template<std::uint32_t N>
+    constexpr AWPatch(AWFMRender render, const AWFMOperator (&operators)[N], std::uint8_t carriers) :
+        _fm_render(render), _data(nullptr), _start(start<Generator::FM>), _fm_operators(operators), _fm_count(N), _fm_carriers(carriers)
+    {
+        static_assert(N > 0 && N <= AWFMState::MAX_OPERATORS);
+    }
+    
+    // Callback function with per-voice state initialized by 'state_init'. Use withState() instead of calling this directly.
+    constexpr AWPatch(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p, void* state), void* initial, void (*state_init)(void*, const void*)) :
+        _callback_with_data(callback), _data(initial), _state_init(state_init), _start(start<Generator::WITH_DATA>)
+    {
+    }
+    
+    // Callback function with per-voice state. Every voice playing the patch gets its own 'State' object from its state
+    // slot, which is passed to the callback instead of shared user data. The object is default constructed when a note
+    // starts, so stateful patches (filters, feedback, random walks) can be played on several channels at once.
+    template<typename State>
+    static constexpr AWPatch withState(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p, void* state)) {
+        checkState<State>();
+        return AWPatch(callback, nullptr, initState<State>);
+    }
+    
+    // Same as above, but each voice's state is copied from 'initial' when a note starts
+    template<typename State>
+    static constexpr AWPatch withState(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p, void* state), State& initial) {
+        checkState<State>();
+        return AWPatch(callback, reinterpret_cast<void*>(&initial), initState<State>);
+    }
     
     union {
         std::int32_t (*_callback)(std::uint32_t, std::uint32_t);
         std::int32_t (*_callback_with_data)(std::uint32_t, std::uint32_t, void* ptr);
+        AWFMRender _fm_render;
     };
     void* _data = nullptr;
     
+    // Initializes per-voice state in 'slot'. Null if the patch has no per-voice state.
+    void (*_state_init)(void* slot, const void* initial) = nullptr;
+    
+    // Connects a voice that has just started a note of the patch to a LibAudio channel, rendered by the loop of the
+    // patch's generator. Set when the patch is built, so a program only links the render loops of the kinds of patches
+    // it builds. Defined after AWSynthSource.
+    template<Generator generator>
+    static void start(AWSynthSource& voice, std::uint32_t channel, bool lowLatency);
+    void (*_start)(AWSynthSource& voice, std::uint32_t channel, bool lowLatency) = nullptr;
+    
+    static constexpr std::uint32_t STATE_SIZE = PROJ_AWSYNTH_VOICE_STATE_SIZE;
+    
+    template<typename State>
+    static constexpr void checkState() {
+        static_assert(sizeof(State) <= STATE_SIZE, "Per-voice state doesn't fit, increase PROJ_AWSYNTH_VOICE_STATE_SIZE");
+        static_assert(alignof(State) <= alignof(std::max_align_t), "Per-voice state is over-aligned");
+        static_assert(std::is_trivially_destructible<State>::value, "Per-voice state is never destroyed");
+    }
+    
+    template<typename State>
+    static void initState(void* slot, const void* initial) {
+        if(initial != nullptr) {
+            new (slot) State(*reinterpret_cast<const State*>(initial));
+        }
+        else {
+            new (slot) State();
+        }
+    }
+    
+    const AWFMOperator* _fm_operators = nullptr;
+    std::uint8_t _fm_count = 0;
+    std::uint8_t _fm_carriers = 0;
+    
+    // Plucked string voice. Amplitudes and release shape the sound as with any patch, the string itself decays on its
+    // own at a rate that depends on the pitch. Semitones, glide and pitch bends work as usual.
+    static constexpr AWPatch pluck() {
+        AWPatch patch(static_cast<std::int32_t (*)(std::uint32_t, std::uint32_t)>(nullptr));
+        patch._pluck_init = AWPluckState::init;
+        patch._start = start<Generator::PLUCK>;
+        return patch;
+    }
+    
+    // Takes a delay line for a plucked string voice. Null for other patches.
+    void (*_pluck_init)(void* slot, const void* owner, std::uint32_t rate_Q24) = nullptr;
+    
     constexpr AWPatch& algorithm(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p)) {
         _callback = callback;
         _data = nullptr;
+        _state_init = nullptr;
+        _start = start<Generator::PLAIN>;
+        _fm_operators = nullptr;
+        _pluck_init = nullptr;
         return *this;
     }
     
@@ -27,9 +338,17 @@ struct AWPatch {
     constexpr AWPatch& algorithm(std::int32_t (*callback)(std::uint32_t t, std::uint32_t p, void* data), T& obj) {
         _callback_with_data = callback;
         _data = reinterpret_cast<void*>(&obj);
+        _state_init = nullptr;
+        _start = start<Generator::WITH_DATA>;
+        _fm_operators = nullptr;
+        _pluck_init = nullptr;
         return *this;
     }
     
+    // Feedback level (0...100 %) of the FM voice, on the same scale as operator modulation depth
+    std::int16_t _fm_feedback_Q10 = 0;
+    constexpr AWPatch& feedback(std::uint8_t val) { _fm_feedback_Q10 = AWFMOperator::depth(val < 100 ? val : 100); return *this; }
+    
     std::uint8_t _volume = 100;
     constexpr AWPatch& volume(std::uint8_t val) { _volume = val < 100 ? val : 100; return *this; }
     constexpr std::uint8_t volume() const { return _volume; }
@@ -46,6 +365,29 @@ struct AWPatch {
     constexpr AWPatch& release(uint8_t val) { _release = val; return *this; }
     constexpr std::uint8_t release() const { return _release; }
     
+    // Amount of the output sent to the shared effects bus, 0...100 %
+    std::uint8_t _send = 0;
+    constexpr AWPatch& send(uint8_t val) { _send = val < 100 ? val : 100; return *this; }
+    constexpr std::uint8_t send() const { return _send; }
+    
+    // Unison plays 'count' (1...4) copies of the callback detuned up to 'detune' cents from the played pitch. They share
+    // the envelopes and glide of the voice, so a thick sound costs the control processing of just one voice. A callback
+    // is called 'count' times per sample, so it shouldn't keep state of its own. Not used by FM and plucked voices.
+    static constexpr std::uint8_t MAX_UNISON = 4;
+    std::uint8_t _unison = 1;
+    std::uint8_t _detune = 0;
+    constexpr AWPatch& unison(uint8_t count, uint8_t detune) { _unison = count > 1 ? (count < MAX_UNISON ? count : MAX_UNISON) : 1; _detune = detune < 100 ? detune : 100; return *this; }
+    constexpr std::uint8_t unison() const { return _unison; }
+    constexpr std::uint8_t detune() const { return _detune; }
+    
+    // Evaluates the callback only every 1, 2 or 4 samples. Samples in between repeat the last value or, if 'interpolate'
+    // is true, are interpolated linearly. Saves CPU on bass lines, noise drums and other patches with little treble.
+    std::uint8_t _divider = 1;
+    bool _interpolate = false;
+    constexpr AWPatch& divider(uint8_t val, bool interpolate=false) { _divider = val >= 4 ? 4 : (val >= 2 ? 2 : 1); _interpolate = interpolate; return *this; }
+    constexpr std::uint8_t divider() const { return _divider; }
+    constexpr bool interpolate() const { return _interpolate; }
+    
     struct Envelope {
         static constexpr std::uint32_t SIZE = 32;
         
@@ -102,7 +444,19 @@ struct AWPatch {
     constexpr AWPatch& semitones(const Envelope& env) { _semitone_env = env; return *this; }
     constexpr const Envelope& semitones() const { return _semitone_env; }
     
-    // Takes a class member function and wraps it into a regular function pointer
+    // Takes a class member function and wraps it into a regular function pointer, e.g. makeCallback<&RingMod::callback>().
+    // The function pointer can be used with shared user data or with per-voice state.
+    template<auto method>
+    static constexpr auto makeCallback() {
+        return +[](std::uint32_t t_, std::uint32_t p_, void* data)->std::int32_t {
+            using Class = typename MemberClass<decltype(method)>::type;
+            Class& obj = *reinterpret_cast<Class*>(data);
+            return (obj.*method)(t_, p_);
+        };
+    }
+    
+    // Same as above, for a member function pointer given at runtime. Only one member function per class can be
+    // wrapped this way, because the pointer is kept in a static variable.
     template<typename T>
     static auto makeCallback(std::int32_t (T::*method)(std::uint32_t t, std::uint32_t p)) {
         static decltype(method) static_ptr;
@@ -113,52 +467,153 @@ struct AWPatch {
             return (obj.*static_ptr)(t_, p_);
         };
     }
+    
+    template<typename Method>
+    struct MemberClass;
+    
+    template<typename T>
+    struct MemberClass<std::int32_t (T::*)(std::uint32_t, std::uint32_t)> { using type = T; };
 };
 
+template<std::uint32_t channel, std::uint32_t Blocks>
+class AWRenderAhead;
+
+template<unsigned Voices=NUM_CHANNELS>
+class AWEngine;
+
+template<unsigned Voices>
+class AWVoiceBank;
+
 class AWSynthSource {
     
-    public:
+    template<std::uint32_t, std::uint32_t>
+    friend class AWRenderAhead;
+    
+    template<unsigned>
+    friend class AWEngine;
     
+    template<unsigned>
+    friend class AWVoiceBank;
+    
+    template<std::uint32_t>
+    friend class AWControlAhead;
+    
+    friend class AWTriggers;
+    
+    friend class AWLoadTest;
+    
+    friend struct AWPatch;
+    
+    public:
+        
+        // Voices of the LibAudio channels are owned by the default AWEngine. These are defined after it.
         template<unsigned channel>
-        static AWSynthSource& getInstance() { static AWSynthSource self; return self; }
+        static AWSynthSource& getInstance();
         
         template<unsigned channel=0, bool lowLatency=true>
-        static AWSynthSource& play(const AWPatch& patch, std::uint8_t midikey=48) {
-            auto& self = getInstance<channel>();
-            self.init(patch, midikey);
+        static AWSynthSource& play(const AWPatch& patch, std::uint8_t midikey=48);
+
+#ifdef PROJ_AWSYNTH_COMPACT
+        static AWSynthSource& getInstance(unsigned channel);
+        
+        // Same as above, but channel and latency are given at runtime. All channels share one copy of the render loop.
+        static AWSynthSource& play(unsigned channel, bool lowLatency, const AWPatch& patch, std::uint8_t midikey=48);
+#endif
+        
+        inline void release() {
+            AWSYNTH_TRACE(RELEASE, _channel, 0);
+            _released = true;
+        }
+        
+        // Changes the effects bus send amount (0...100 %) of the playing voice
+        inline void send(std::uint8_t val) {
+            _send_Q8 = ((val < 100 ? val : 100) << 8) / 100;
+        }
+
+#ifdef PROJ_AWSYNTH_HOTSWAP
+        // Makes every voice that is playing 'from' continue with 'to' at its next control value update, without
+        // restarting the note. Both patches must use the same kind of callback.
+        static void hotSwap(const AWPatch& from, const AWPatch& to) {
+            forEachVoice([&](AWSynthSource& voice) {
+                if(voice._patch.load() == &from) {
+                    voice._next_patch.store(&to);
+                }
+            });
+        }
+        
+        // Returns true if a voice is still sounding 'patch' or is about to switch to it. Only reads the atomic patch
+        // pointers, so it's safe while the audio thread renders the voices.
+        static bool isPlaying(const AWPatch& patch) {
+            bool playing = false;
+            forEachVoice([&](AWSynthSource& voice) {
+                playing |= voice._patch.load() == &patch || voice._next_patch.load() == &patch;
+            });
+            return playing;
+        }
+#endif
+        
+        // Advances the voice by 'samples' as if it had been rendered, without evaluating the callback. Control values
+        // are updated one envelope step at a time, or one control period at a time while the pitch is sliding or an FM
+        // voice is playing. State that only the callback keeps (FM feedback, per-voice state) is not advanced.
+        // Call right after play(), before the voice is rendered again.
+        void seek(std::uint32_t samples) {
+            constexpr std::uint32_t PERIOD = (_ONE_Q20 + _CV_RATE_Q20 - 1) / _CV_RATE_Q20;
             
-            if(patch._data == nullptr) {
-                // Plain callback function, no user data
-                self._callback = patch._callback;
-                self._data = nullptr;
-                
-                if(lowLatency) {
-                    lowLatencyMix<channel>(self);
+            _hold_count = 0;
+            _hold_val = 0;
+            
+            while(samples > 0) {
+                // Number of samples until the next control value update
+                std::uint32_t span = (_cv_accu_Q20 + _CV_RATE_Q20 - 1) / _CV_RATE_Q20;
+                if(samples < span) {
+                    skip(samples);
+                    return;
                 }
                 
-                Audio::connect(channel, &self, channel == 0 ? copy : mix<channel>);
-            }
-            else {
-                // Callback function with user data
-                self._callback_with_data = patch._callback_with_data;
-                self._data = patch._data;
+                bool steady = span == PERIOD && _delta_pitchbend_Q10 == Pitch{} && _glide_accu_Q14 == GlideAccu{} && !_fm_active;
+                if(steady) {
+                    // Pitch may still change once after an envelope step
+                    steady = _rate_Q24 == rate(_midikey, _base_pitchbend_Q10.to<15>());
+                }
                 
-                if(lowLatency) {
-                    lowLatencyMixAlt<channel>(self);
+                if(steady) {
+                    // Pitch is steady, so whole control periods up to the next envelope step can be skipped at once.
+                    // The last two updates before the step are run normally to get the gain ramp right.
+                    std::int32_t room = _ONE_Q24 - _step_div_Q24 - _step_accu_Q24 - 1;
+                    std::uint32_t count = room > 0 ? room / (PERIOD*_step_rate_Q24) : 0;
+                    count = count < samples/PERIOD ? count : samples/PERIOD;
+                    if(count > 2) {
+                        count -= 2;
+                        
+                        std::uint64_t phase_Q24 = _phase_Q24 + static_cast<std::uint64_t>(_rate_Q24)*PERIOD*count;
+                        _p += phase_Q24 >> (24-8);
+                        _phase_Q24 = phase_Q24 & ((1<<(24-8)) - 1);
+                        for(std::uint32_t idx = 0; idx+1 < _unison; ++idx) {
+                            phase_Q24 = _unison_phase_Q24[idx] + static_cast<std::uint64_t>(_unison_rate_Q24[idx])*PERIOD*count;
+                            _unison_p[idx] += phase_Q24 >> (24-8);
+                            _unison_phase_Q24[idx] = phase_Q24 & ((1<<(24-8)) - 1);
+                        }
+                        _step_accu_Q24 += _step_rate_Q24*PERIOD*count;
+                        
+                        if(_released) {
+                            std::int32_t volume_Q14 = _volume_Q14.raw - static_cast<std::int32_t>(_release_rate_Q14.raw)*count;
+                            _volume_Q14 = Volume::fromRaw(volume_Q14 > 0 ? volume_Q14 : 0);
+                        }
+                        
+                        samples -= PERIOD*count;
+                        continue;
+                    }
                 }
                 
-                Audio::connect(channel, &self, channel == 0 ? copyAlt : mixAlt<channel>);
+                skip(span);
+                samples -= span;
+                _cv_accu_Q20 = _ONE_Q20;
+                update();
             }
-            
-            return self;
-        }
-        
-        inline void release() {
-            _released = true;
         }
     
     public:
-    
+        
         // Waveform generators turn input variable 'p' (phase, 256 is full period) into a waveform.
         // Output is in the range -128..128
         
@@ -205,19 +660,67 @@ class AWSynthSource {
         }
     
     private:
-    
+        
         enum struct Effect { STEP=0, ATTACK=1, DECAY=2, SLIDE=3 };
         
+        using Generator = AWPatch::Generator;
+        
         static constexpr std::uint32_t _RATE_1HZ_Q32 = (static_cast<std::uint64_t>(1) << 32) / POK_AUD_FREQ;
         
         static constexpr std::int32_t _ONE_Q20 = 1<<20;
         static constexpr std::int32_t _ONE_Q24 = 1<<24;
         
         // Control values are updated 120 times per second
-        static constexpr std::uint32_t _CV_RATE_Q20 = (240*_ONE_Q20 + POK_AUD_FREQ-1) / POK_AUD_FREQ;
+        static constexpr std::uint32_t _CV_RATE_Q20 = (AWFMOperator::CONTROL_RATE*_ONE_Q20 + POK_AUD_FREQ-1) / POK_AUD_FREQ;
+        
+        // Unison oscillators are detuned by these fractions of the patch detune, and the sum is scaled by 1/sqrt(count)
+        static constexpr std::int32_t _CENT_Q24 = (1<<24) * 0.693147 / 1200;          // 0.693147=ln(2)
+        static constexpr std::int16_t _UNISON_SPREAD_Q8[AWPatch::MAX_UNISON-1] = {256, -256, 128};
+        static constexpr std::int16_t _UNISON_GAIN_Q8[AWPatch::MAX_UNISON] = {256, 181, 148, 128};
+        
+        // Formats of the control values. Envelope levels are 0...31/32 and pitch bends -32...31 semitones, slides and
+        // glides can span twice that.
+        using Level = Fixed<11, 10>;            // Amplitude level before converting to gain
+        using Pitch = Fixed<14, 10>;            // Pitch bend in octaves
+        using Gain = Fixed<12, 10>;
+        using Volume = Fixed<16, 14>;
+        using Glide = Fixed<15, 10>;            // Glide interval in octaves
+        using GlideAccu = Fixed<16, 14>;        // Remaining part of the glide interval, 1...0
+        using Exponent = Fixed<21, 15>;         // Octaves from A4 to the played pitch
+        using Fraction = Fixed<21, 20, false>;  // Position within a control period or envelope step, 0...1
+        
+        static_assert(Level::holds(31/32.0) && Level::holds(-31/32.0), "Level doesn't fit its field");
+        static_assert(Pitch::holds(63/12.0) && Pitch::holds(-63/12.0), "Pitch slide doesn't fit its field");
+        static_assert(Gain::holds(1.0) && Gain::holds(-1.0), "Gain doesn't fit its field");
+        static_assert(Volume::holds(1.0) && GlideAccu::holds(1.0), "Volume doesn't fit its field");
+        static_assert(Glide::holds(127/12.0) && Glide::holds(-127/12.0), "Glide over the whole key range doesn't fit its field");
+        static_assert(Exponent::holds((127-69)/12.0 + 63/12.0 + 127/12.0) && Exponent::holds(-69/12.0 - 63/12.0 - 127/12.0), "Pitch doesn't fit");
+        
+        // Control values of a voice after one update(), computed ahead of the audio
+        struct ControlFrame {
+            std::uint32_t t;
+            std::int32_t step_accu_Q24;
+            std::uint32_t rate_Q24;
+            std::uint32_t unison_rate_Q24[AWPatch::MAX_UNISON-1];
+            Gain target_gain_Q10;
+            Gain delta_gain_Q10;
+            Volume volume_Q14;
+            Level base_level_Q10;
+            Level delta_level_Q10;
+            Pitch base_pitchbend_Q10;
+            Pitch delta_pitchbend_Q10;
+            GlideAccu glide_accu_Q14;
+            std::uint8_t levels_idx;
+            std::uint8_t semitones_idx;
+            bool released;
+        };
         
-        static constexpr std::int32_t _LEVEL_SCALE_Q10 = (1<<5);                    // Scales amplitude level to fixed point Q10
-        static constexpr std::int32_t _SEMITONE_SCALE_Q15 = ((1<<15) + 12-1) / 12;  // Scales semitones to octaves as fixed point Q15
+        // Most control value updates within one 512 sample buffer
+        static constexpr std::uint32_t _MAX_CONTROL_FRAMES = 512 / ((_ONE_Q20 + _CV_RATE_Q20 - 1) / _CV_RATE_Q20) + 1;
+        
+        static constexpr Fixed<28, 32, false> _RATE_440HZ_Q32 = Fixed<28, 32, false>::fromRaw(static_cast<std::uint64_t>(_RATE_1HZ_Q32) * 440);
+        static constexpr Fixed<13, 15, false> _SEMITONE_SCALE_Q15 = Fixed<13, 15, false>::fromRaw(((1<<15) + 12-1) / 12);  // Scales semitones to octaves
+        static constexpr Fixed<24, 30, false> _PERCENT_Q30 = Fixed<24, 30, false>::fromRaw((1<<30) / 100);
         
         static constexpr std::uint16_t _SEMITONES_Q15[13] = {
             static_cast<std::uint16_t>((1<<15) * 0.50000), 
@@ -239,26 +742,31 @@ class AWSynthSource {
             _t(0), _p(0), 
             _rate_Q24(0), _phase_Q24(0),
             _cv_accu_Q20(0), _step_rate_Q24(0), _step_accu_Q24(0),_step_div_Q24(0), 
-            _levels(nullptr), _levels_idx(0), _levels_loop(0), _levels_end(0), _base_level_Q10(0), _delta_level_Q10(0),
-            _semitones(nullptr), _semitones_idx(0), _semitones_loop(0), _semitones_end(0), _base_pitchbend_Q10(0), _delta_pitchbend_Q10(0),
-            _target_gain_Q10(0), _delta_gain_Q10(0),
-            _release_rate_Q14(0), _volume_Q14(0),
-            _glide_interval_Q10(0), _glide_rate_Q14(0), _glide_accu_Q14(0),
+            _levels(nullptr), _levels_idx(0), _levels_loop(0), _levels_end(0), _base_level_Q10(), _delta_level_Q10(),
+            _semitones(nullptr), _semitones_idx(0), _semitones_loop(0), _semitones_end(0), _base_pitchbend_Q10(), _delta_pitchbend_Q10(),
+            _target_gain_Q10(), _delta_gain_Q10(),
+            _release_rate_Q14(), _volume_Q14(),
+            _glide_interval_Q10(), _glide_rate_Q14(), _glide_accu_Q14(),
             _midikey(0), _released(true), 
+            _send_Q8(0),
+            _unison(1), _unison_p{}, _unison_phase_Q24{}, _unison_rate_Q24{}, _unison_detune_Q16{},
+            _divider_shift(0), _interpolate(false), _hold_count(0), _hold_val(0), _hold_prev(0),
             _callback(nullptr),
-            _data(nullptr)
+            _data(nullptr),
+            _state{}, _state_owner(nullptr), _fm_active(false), _pluck_active(false)
         {
         }
         
         inline void init(const AWPatch& patch, std::uint8_t midikey) {
-            if(patch.glide() > 0 && !_released) {
+            const bool legato = patch.glide() > 0 && !_released;
+            if(legato) {
                 // Calculate remaining glide interval in case the current patch hasn't finished it's pitch glide
-                _glide_interval_Q10 = _glide_interval_Q10*_glide_accu_Q14 / (1<<14);
+                _glide_interval_Q10 = (_glide_interval_Q10*_glide_accu_Q14).to<10>().as<15>();
                 
                 // Then add interval from this to previous midikey
-                _glide_interval_Q10 += (1<<10) * (_midikey-midikey) / 12;
-                _glide_rate_Q14 = (1<<14) / (patch.glide()*patch.step());
-                _glide_accu_Q14 = 1<<14;   // Envelope starts from full glide interval and glides down to zero to current pitch
+                _glide_interval_Q10 += Glide::fromInt(_midikey-midikey) / 12;
+                _glide_rate_Q14 = GlideAccu::one() / (patch.glide()*patch.step());
+                _glide_accu_Q14 = GlideAccu::one();   // Envelope starts from full glide interval and glides down to zero to current pitch
             }
             else {
                 _t = 0;
@@ -270,7 +778,7 @@ class AWSynthSource {
                 _step_div_Q24 = _ONE_Q24 / (2*patch.step());
                 _step_accu_Q24 = 0;
                 
-                _volume_Q14 = (patch.volume() * ((1<<30) / 100)) >> 16;
+                _volume_Q14 = percentToVolume(patch.volume());
                 _release_rate_Q14 = patch.release() > 0 ? (_volume_Q14 / (patch.release()*2*patch.step())) : _volume_Q14;
                 
                 _levels = patch.amplitudes().data();
@@ -278,112 +786,137 @@ class AWSynthSource {
                 _levels_end = patch.amplitudes().end();
                 _levels_idx = 0;
                 
-                _base_level_Q10 = (_levels[0]>>2)*_LEVEL_SCALE_Q10;
-                _delta_level_Q10 = 0;
+                startLevel(_levels[0], Level{}, true, _base_level_Q10, _delta_level_Q10);
                 
-                switch(static_cast<Effect>(_levels[0]&3)) {
-                    case Effect::ATTACK:
-                        _delta_level_Q10 = _base_level_Q10;
-                        _base_level_Q10 = 0;
-                        break;
-                    
-                    case Effect::DECAY:
-                        _delta_level_Q10 = -_base_level_Q10;
-                        break;
-                    
-                    default:
-                        break;
-                }
-                
-                std::int32_t level_Q10 = _base_level_Q10 + _delta_level_Q10*(_step_div_Q24>>4)/_ONE_Q20;
-                _target_gain_Q10 = levelToGain((_volume_Q14*level_Q10) >> 14);
-                _delta_gain_Q10 = _target_gain_Q10 - 0;
+                Level level_Q10 = _base_level_Q10 + (_delta_level_Q10*stepFraction(_step_div_Q24)).to<10>().as<11>();
+                _target_gain_Q10 = levelToGain((_volume_Q14*level_Q10).to<10>());
+                _delta_gain_Q10 = _target_gain_Q10;
                 
                 _semitones = patch.semitones().data();
                 _semitones_loop = patch.semitones().loop();
                 _semitones_end = patch.semitones().end();
                 _semitones_idx = 0;
                 
-                _base_pitchbend_Q10 = ((_semitones[0]>>2)*_SEMITONE_SCALE_Q15)>>5;
-                _delta_pitchbend_Q10 = 0;
+                startPitch(_semitones[0], true, _base_pitchbend_Q10, _delta_pitchbend_Q10);
                 
-                switch(static_cast<Effect>(_semitones[0]&3)) {
-                    case Effect::ATTACK:
-                        _delta_pitchbend_Q10 = _base_pitchbend_Q10;
-                        _base_pitchbend_Q10 = 0;
-                        break;
-                    
-                    case Effect::DECAY:
-                        _delta_pitchbend_Q10 = -_base_pitchbend_Q10;
-                        break;
-                    
-                    default:
-                        break;
+                Exponent pitchbend_Q15 = _base_pitchbend_Q10.to<15>() + (_delta_pitchbend_Q10*halfStep(_step_div_Q24)).to<15>();
+                _rate_Q24 = rate(midikey, pitchbend_Q15);
+                _phase_Q24 = 0;
+                
+                // Unison oscillators start a third of a period apart, so that their sum doesn't begin with a spike
+                for(std::uint32_t idx = 0; idx+1 < AWPatch::MAX_UNISON; ++idx) {
+                    _unison_p[idx] = 85*(idx+1);
+                    _unison_phase_Q24[idx] = 0;
                 }
                 
-                std::int32_t pitchbend_Q15 = (_base_pitchbend_Q10<<5) + _delta_pitchbend_Q10*(_step_div_Q24>>(1+9))/(1<<10);
-                _rate_Q24 = (static_cast<std::uint64_t>(_RATE_1HZ_Q32) * 440 * pow2((midikey-69)*_SEMITONE_SCALE_Q15 + pitchbend_Q15)) >> (8+15);
-                _phase_Q24 = 0;
+                _glide_interval_Q10 = {};
+                _glide_rate_Q14 = {};
+                _glide_accu_Q14 = {};
+            }
             
-                _glide_interval_Q10 = 0;
-                _glide_rate_Q14 = 0;
-                _glide_accu_Q14 = 0;
+            // Per-voice state is kept if the same patch is gliding from the previous note
+            bool keep_state = legato && _state_owner == &patch;
+            if(_pluck_active && !keep_state) {
+                pluck().free();
+            }
+            _state_owner = nullptr;
+            _fm_active = false;
+            _pluck_active = false;
+            if(patch._fm_operators != nullptr) {
+                if(!keep_state) {
+                    new (_state) AWFMState();
+                    fm().init(patch._fm_operators, patch._fm_count, patch._fm_carriers, patch._fm_feedback_Q10);
+                }
+                _state_owner = &patch;
+                _fm_active = true;
+            }
+            else if(patch._pluck_init != nullptr) {
+                if(!keep_state) {
+                    patch._pluck_init(_state, this, _rate_Q24);
+                }
+                _state_owner = &patch;
+                _pluck_active = true;
+            }
+            else if(patch._state_init != nullptr) {
+                if(!keep_state) {
+                    patch._state_init(_state, patch._data);
+                }
+                _state_owner = &patch;
             }
             
             _midikey = midikey;
             _released = false;
+            
+            send(patch.send());
+            
+            _unison = (patch._fm_operators == nullptr && patch._pluck_init == nullptr) ? patch.unison() : 1;
+            for(std::uint32_t idx = 0; idx+1 < _unison; ++idx) {
+                _unison_detune_Q16[idx] = (patch.detune() * _CENT_Q24 * _UNISON_SPREAD_Q8[idx]) >> 16;
+            }
+            detuneUnison();
+            
+            _divider_shift = patch.divider() >> 1;
+            _interpolate = patch.interpolate();
+            _hold_count = 0;
+            _hold_val = 0;
+
+#ifdef PROJ_AWSYNTH_TRACE
+            _audible = false;
+#endif
+#ifdef PROJ_AWSYNTH_HOTSWAP
+            _patch.store(&patch);
+            _next_patch.store(nullptr);
+#endif
         }
         
         inline void update() {
+            AWSYNTH_TRACE_UPDATE(_channel);
+
+#ifdef PROJ_AWSYNTH_HOTSWAP
+            if(const AWPatch* next = _next_patch.exchange(nullptr)) {
+                swap(*next);
+            }
+#endif
+            
+            wrapPhases();
+            bool released = _released;
+            updateControls();
+            traceRelease(released);
+        }
+        
+        // Moves the whole periods of the fractional phases to the oscillator positions
+        inline void wrapPhases() {
             _p += _phase_Q24>>(24-8);
             _phase_Q24 &= (1<<(24-8)) - 1;
-            
+            for(std::uint32_t idx = 0; idx+1 < _unison; ++idx) {
+                _unison_p[idx] += _unison_phase_Q24[idx]>>(24-8);
+                _unison_phase_Q24[idx] &= (1<<(24-8)) - 1;
+            }
+        }
+        
+        // Envelopes, glide and gain and rate of the oscillators. Doesn't depend on the oscillators, so it can also be run
+        // ahead of the audio on a copy of the voice, see computeFrames().
+        inline void updateControls() {
             if(_released) {
                 _volume_Q14 -= _release_rate_Q14;
-                if(_volume_Q14 <= 0) {
-                    _volume_Q14 = 0;
+                if(_volume_Q14 <= Volume{}) {
+                    _volume_Q14 = {};
                 }
             }
             
-            std::int32_t level_Q10 = _base_level_Q10;
-            std::int32_t pitchbend_Q15 = _base_pitchbend_Q10<<5;
+            Level level_Q10 = _base_level_Q10;
+            Exponent pitchbend_Q15 = _base_pitchbend_Q10.to<15>();
             
             if(_step_accu_Q24+_step_div_Q24 >= _ONE_Q24) {
                 _step_accu_Q24 = -_step_div_Q24;
                 _t += 256;
                 
                 level_Q10 += _delta_level_Q10;
-                _delta_level_Q10 = 0;
+                _delta_level_Q10 = {};
                 
-                std::uint32_t len = (_levels_end > 0 && _levels_end < AWPatch::Envelope::SIZE) ? _levels_end : AWPatch::Envelope::SIZE;
-                if(_levels_idx < len) {
-                    ++_levels_idx;
-                    if(_levels_idx >= len) {
-                        _levels_idx = (_levels_loop < _levels_end) ? _levels_loop : AWPatch::Envelope::SIZE;
-                    }
-                    
+                if(advanceEnvelope(_levels_idx, _levels_loop, _levels_end)) {
                     if(_levels_idx < AWPatch::Envelope::SIZE) {
-                        _base_level_Q10 = (_levels[_levels_idx]>>2)*_LEVEL_SCALE_Q10;
-                        
-                        switch(static_cast<Effect>(_levels[_levels_idx]&3)) {
-                            case Effect::ATTACK:
-                                _delta_level_Q10 = _base_level_Q10;
-                                _base_level_Q10 = 0;
-                                break;
-                            
-                            case Effect::DECAY:
-                                _delta_level_Q10 = -_base_level_Q10;
-                                break;
-                            
-                            case Effect::SLIDE:
-                                _delta_level_Q10 = _base_level_Q10 - level_Q10;
-                                _base_level_Q10 = level_Q10;
-                                break;
-                            
-                            default:
-                                break;
-                        }
-                        
+                        startLevel(_levels[_levels_idx], level_Q10, false, _base_level_Q10, _delta_level_Q10);
                         if(_base_level_Q10 < level_Q10) {
                             level_Q10 = _base_level_Q10;
                         }
@@ -391,191 +924,587 @@ class AWSynthSource {
                     else {
                         _base_level_Q10 = level_Q10;
                         if(!_released) {
-                            release();  // Trigger release when we reach the end of the level envelope
+                            _released = true;   // Trigger release when we reach the end of the level envelope
                             if(_release_rate_Q14 >= _volume_Q14) {
-                                _volume_Q14 = 0;
+                                _volume_Q14 = {};
                             }
                         }
                     }
                 }
                 
-                pitchbend_Q15 += (_delta_pitchbend_Q10<<5) - _delta_pitchbend_Q10*(_step_div_Q24>>(1+9))/(1<<10);
+                pitchbend_Q15 += _delta_pitchbend_Q10.to<15>() - (_delta_pitchbend_Q10*halfStep(_step_div_Q24)).to<15>();
                 
                 _base_pitchbend_Q10 += _delta_pitchbend_Q10;
-                _delta_pitchbend_Q10 = 0;
+                _delta_pitchbend_Q10 = {};
                 
-                len = (_semitones_end > 0 && _semitones_end < AWPatch::Envelope::SIZE) ? _semitones_end : AWPatch::Envelope::SIZE;
-                if(_semitones_idx < len) {
-                    ++_semitones_idx;
-                    if(_semitones_idx >= len) {
-                        _semitones_idx = (_semitones_loop < _semitones_end) ? _semitones_loop : AWPatch::Envelope::SIZE;
-                    }
-                    
-                    if(_semitones_idx < AWPatch::Envelope::SIZE) {
-                        std::int32_t next_pitchbend_Q10 = ((_semitones[_semitones_idx]>>2)*_SEMITONE_SCALE_Q15)>>5;
-                        
-                        switch(static_cast<Effect>(_semitones[_semitones_idx]&3)) {
-                            case Effect::STEP:
-                                _base_pitchbend_Q10 = next_pitchbend_Q10;
-                                break;
-                            
-                            case Effect::ATTACK:
-                                _delta_pitchbend_Q10 = next_pitchbend_Q10;
-                                _base_pitchbend_Q10 = 0;
-                                break;
-                            
-                            case Effect::DECAY:
-                                _delta_pitchbend_Q10 = -next_pitchbend_Q10;
-                                _base_pitchbend_Q10 = next_pitchbend_Q10;
-                                break;
-                            
-                            case Effect::SLIDE:
-                                _delta_pitchbend_Q10 = next_pitchbend_Q10 - _base_pitchbend_Q10;
-                                break;
-                            
-                            default:
-                                break;
-                        }
-                    }
+                if(advanceEnvelope(_semitones_idx, _semitones_loop, _semitones_end) && _semitones_idx < AWPatch::Envelope::SIZE) {
+                    startPitch(_semitones[_semitones_idx], false, _base_pitchbend_Q10, _delta_pitchbend_Q10);
                 }
             }
             else {
-                level_Q10 += _delta_level_Q10*((_step_accu_Q24 + _step_div_Q24)>>4)/_ONE_Q20;
-                pitchbend_Q15 += _delta_pitchbend_Q10*((_step_accu_Q24 + (_step_div_Q24>>1))>>9)/(1<<10);
+                level_Q10 += (_delta_level_Q10*stepFraction(_step_accu_Q24 + _step_div_Q24)).to<10>().as<11>();
+                pitchbend_Q15 += (_delta_pitchbend_Q10*Fixed<26, 24>::fromRaw(_step_accu_Q24 + (_step_div_Q24>>1)).to<15>()).to<15>();
             }
             
-            std::int32_t prev_gain_Q10 = _target_gain_Q10;
-            _target_gain_Q10 = levelToGain((_volume_Q14*level_Q10) >> 14);
+            Gain prev_gain_Q10 = _target_gain_Q10;
+            _target_gain_Q10 = levelToGain((_volume_Q14*level_Q10).to<10>());
             _delta_gain_Q10 = _target_gain_Q10 - prev_gain_Q10;
             
-            if(_glide_accu_Q14 > 0) {
+            if(_glide_accu_Q14 > GlideAccu{}) {
                 _glide_accu_Q14 -= _glide_rate_Q14;
-                if(_glide_accu_Q14 > 0) {
-                    pitchbend_Q15 += (_glide_interval_Q10*_glide_accu_Q14) / (1<<9);
+                if(_glide_accu_Q14 > GlideAccu{}) {
+                    pitchbend_Q15 += (_glide_interval_Q10*_glide_accu_Q14).to<15>();
                 }
                 else {
-                    _glide_accu_Q14 = 0;
+                    _glide_accu_Q14 = {};
                 }
             }
             
-            _rate_Q24 = (static_cast<std::uint64_t>(_RATE_1HZ_Q32) * 440 * pow2((_midikey-69)*_SEMITONE_SCALE_Q15 + pitchbend_Q15)) >> (8+15);
+            _rate_Q24 = rate(_midikey, pitchbend_Q15);
+            detuneUnison();
+            
+            if(_fm_active) {
+                fm().update();
+            }
         }
         
-        inline std::uint8_t tick() {
-            std::int32_t gain_Q10 = _target_gain_Q10 - _delta_gain_Q10*_cv_accu_Q20 / _ONE_Q20;
-            std::int32_t val = _callback(_t+(_step_accu_Q24>>16), _p+(_phase_Q24>>16)) * gain_Q10 / (1<<10);
+        // Advances the control values of the voice over one 512 sample buffer without rendering it, and stores the
+        // result of each update in 'frames' for render<generator, true>(). FM voices update their operators along with
+        // the control values, so they can't be computed ahead.
+        void computeFrames(ControlFrame* frames) {
+            for(std::uint32_t idx = 0; idx < 512;) {
+                std::uint32_t span = (_cv_accu_Q20 + _CV_RATE_Q20 - 1) / _CV_RATE_Q20;
+                span = span < 512-idx ? span : 512-idx;
+                _step_accu_Q24 += span*_step_rate_Q24;
+                _cv_accu_Q20 -= span*_CV_RATE_Q20;
+                idx += span;
+                
+                if(_cv_accu_Q20 <= 0) {
+                    _cv_accu_Q20 = _ONE_Q20;
+                    updateControls();
+                    
+                    auto& frame = *frames++;
+                    frame.t = _t;
+                    frame.step_accu_Q24 = _step_accu_Q24;
+                    frame.rate_Q24 = _rate_Q24;
+                    for(std::uint32_t unison = 0; unison+1 < AWPatch::MAX_UNISON; ++unison) {
+                        frame.unison_rate_Q24[unison] = _unison_rate_Q24[unison];
+                    }
+                    frame.target_gain_Q10 = _target_gain_Q10;
+                    frame.delta_gain_Q10 = _delta_gain_Q10;
+                    frame.volume_Q14 = _volume_Q14;
+                    frame.base_level_Q10 = _base_level_Q10;
+                    frame.delta_level_Q10 = _delta_level_Q10;
+                    frame.base_pitchbend_Q10 = _base_pitchbend_Q10;
+                    frame.delta_pitchbend_Q10 = _delta_pitchbend_Q10;
+                    frame.glide_accu_Q14 = _glide_accu_Q14;
+                    frame.levels_idx = _levels_idx;
+                    frame.semitones_idx = _semitones_idx;
+                    frame.released = _released;
+                }
+            }
+        }
+        
+        // Same as update(), but takes the control values from a frame computed ahead
+        inline void applyFrame(const ControlFrame& frame) {
+            AWSYNTH_TRACE_UPDATE(_channel);
             
-            _step_accu_Q24 += _step_rate_Q24;
-            _phase_Q24 += _rate_Q24;
+            wrapPhases();
             
-            _cv_accu_Q20 -= _CV_RATE_Q20;
-            if(_cv_accu_Q20 <= 0) {
-                _cv_accu_Q20 = _ONE_Q20;
-                update();
+            _t = frame.t;
+            _step_accu_Q24 = frame.step_accu_Q24;
+            _rate_Q24 = frame.rate_Q24;
+            for(std::uint32_t idx = 0; idx+1 < _unison; ++idx) {
+                _unison_rate_Q24[idx] = frame.unison_rate_Q24[idx];
             }
+            _target_gain_Q10 = frame.target_gain_Q10;
+            _delta_gain_Q10 = frame.delta_gain_Q10;
+            _volume_Q14 = frame.volume_Q14;
+            _base_level_Q10 = frame.base_level_Q10;
+            _delta_level_Q10 = frame.delta_level_Q10;
+            _base_pitchbend_Q10 = frame.base_pitchbend_Q10;
+            _delta_pitchbend_Q10 = frame.delta_pitchbend_Q10;
+            _glide_accu_Q14 = frame.glide_accu_Q14;
+            _levels_idx = frame.levels_idx;
+            _semitones_idx = frame.semitones_idx;
             
-            val = val > -128 ? (val < 127 ? val : 127) : -128;  // Clip to 8-bits
-            return val + 128;                                   // Convert to unsigned value
+            bool released = _released;
+            _released = frame.released;
+            traceRelease(released);
+        }
+        
+        // Logs the release triggered by the end of the level envelope. updateControls() may run ahead of the audio on
+        // a copy of the voice, so it's logged when the control values are taken over by the voice that plays.
+        inline void traceRelease(bool released) {
+            if(!released && _released) {
+                AWSYNTH_TRACE(RELEASE, _channel, 0);
+            }
         }
         
-        inline std::uint8_t tickAlt() {
-            std::int32_t gain_Q10 = _target_gain_Q10 - _delta_gain_Q10*_cv_accu_Q20 / _ONE_Q20;
-            std::int32_t val = _callback_with_data(_t+(_step_accu_Q24>>16), _p+(_phase_Q24>>16), _data) * gain_Q10 / (1<<10);
+        // Evaluates the sample source at the current position and returns it scaled by gain and clipped to 8-bits
+        template<Generator generator>
+        inline std::int32_t sample() {
+            Gain gain_Q10 = _target_gain_Q10 - (_delta_gain_Q10*Fraction::fromRaw(_cv_accu_Q20).to<16>()).to<10>().as<12>();
+            std::uint32_t t = _t+(_step_accu_Q24>>16);
             
-            _step_accu_Q24 += _step_rate_Q24;
-            _phase_Q24 += _rate_Q24;
+            auto oscillator = [&](std::uint32_t p) -> std::int32_t {
+                if constexpr(generator == Generator::FM) {
+                    return _fm_render(fm(), p);
+                }
+                else if constexpr(generator == Generator::PLUCK) {
+                    return pluck().render(p);
+                }
+                else if constexpr(generator == Generator::WITH_DATA) {
+                    return _callback_with_data(t, p, _data);
+                }
+                else {
+                    return _callback(t, p);
+                }
+            };
             
-            _cv_accu_Q20 -= _CV_RATE_Q20;
-            if(_cv_accu_Q20 <= 0) {
-                _cv_accu_Q20 = _ONE_Q20;
-                update();
+            std::int32_t val = oscillator(_p+(_phase_Q24>>16));
+            if(generator != Generator::FM && generator != Generator::PLUCK && _unison > 1) {
+                // Unison oscillators are summed and scaled down by the square root of their number
+                for(std::uint32_t idx = 0; idx+1 < _unison; ++idx) {
+                    val += oscillator(_unison_p[idx]+(_unison_phase_Q24[idx]>>16));
+                }
+                val = (val * _UNISON_GAIN_Q8[_unison-1]) >> 8;
             }
+            val = (Fixed<18, 0>::fromRaw(val)*gain_Q10).toInt();
             
-            val = val > -128 ? (val < 127 ? val : 127) : -128;  // Clip to 8-bits
-            return val + 128;                                   // Convert to unsigned value
+            return val > -128 ? (val < 127 ? val : 127) : -128;  // Clip to 8-bits
         }
         
-        static void copy(u8* buffer, void* ptr) {
-            auto& self = *reinterpret_cast<AWSynthSource*>(ptr);
-            for(uint32_t i = 0; i < 512; ++i) {
-                buffer[i] = self.tick();
-            }
-            
-            if(self._volume_Q14 <= 0) {
-                Audio::stop<0>();
+        template<Generator generator>
+        inline std::uint8_t tick() {
+            std::int32_t val = sample<generator>();
+            skip(1);
+            return val + 128;   // Convert to unsigned value
+        }
+        
+        // Advances the voice by 'count' samples without evaluating the callback. Used for spans where gain stays at zero
+        // and for the samples between callback evaluations when the patch has a render divider.
+        inline void skip(std::uint32_t count) {
+            _step_accu_Q24 += count*_step_rate_Q24;
+            _phase_Q24 += count*_rate_Q24;
+            _cv_accu_Q20 -= count*_CV_RATE_Q20;
+            for(std::uint32_t idx = 0; idx+1 < _unison; ++idx) {
+                _unison_phase_Q24[idx] += count*_unison_rate_Q24[idx];
             }
         }
         
-        static void copyAlt(u8* buffer, void* ptr) {
-            auto& self = *reinterpret_cast<AWSynthSource*>(ptr);
-            for(uint32_t i = 0; i < 512; ++i) {
-                buffer[i] = self.tickAlt();
+        // Derives the rates of unison oscillators from the rate of the voice
+        inline void detuneUnison() {
+            for(std::uint32_t idx = 0; idx+1 < _unison; ++idx) {
+                _unison_rate_Q24[idx] = _rate_Q24 + ((static_cast<std::int32_t>(_rate_Q24>>8) * _unison_detune_Q16[idx]) >> 8);
             }
+        }
+        
+        // Renders one 512 sample buffer, one control rate span at a time. If 'mixing' is false the buffer is overwritten,
+        // otherwise the voice is added to it. If 'sending' is true the output is also added to the effects bus. If
+        // 'framed' is true the control values are taken from 'frames' instead of being updated here.
+        // Returns false if the voice has faded out and was retired mid-buffer.
+        // Specialized for each combination of options, which the buffer fills of all channels share.
+        template<bool mixing, Generator generator, bool sending=true, bool framed=false>
+        inline bool render(std::uint8_t* buffer, const ControlFrame* frames=nullptr) {
+            return renderLoop<generator, framed>(buffer, mixing, sending, frames);
+        }
+        
+        // Same as above with the options given at runtime, for one loop per generator in the compact mode and in the
+        // voices of AWRenderAhead.h and AWControlAhead.h. Always inlined, so that the options are folded away when the
+        // caller passes constants.
+        template<Generator generator, bool framed=false>
+        __attribute__((always_inline)) inline bool renderLoop(std::uint8_t* buffer, bool mixing, bool sending, const ControlFrame* frames=nullptr) {
+            std::int16_t* send = (sending && _send_Q8 > 0) ? AWEffectsBus::sendBuffer() : nullptr;
             
-            if(self._volume_Q14 <= 0) {
-                Audio::stop<0>();
+            std::uint32_t idx = 0;
+            while(idx < 512) {
+                // Number of samples until the next control value update
+                std::uint32_t span = (_cv_accu_Q20 + _CV_RATE_Q20 - 1) / _CV_RATE_Q20;
+                span = span < 512-idx ? span : 512-idx;
+                
+                if(_target_gain_Q10 == Gain{} && _delta_gain_Q10 == Gain{}) {
+                    // Gain is zero for the whole span, so the callback output would be multiplied away anyway
+                    if(_volume_Q14 <= Volume{}) {
+                        // Release has finished and the voice stays silent until it is played again
+                        for(std::uint32_t i = idx; !mixing && i < 512; ++i) {
+                            buffer[i] = 128;
+                        }
+                        if constexpr(generator == Generator::PLUCK) {
+                            pluck().free();
+                        }
+#ifdef PROJ_AWSYNTH_HOTSWAP
+                        // A swap that didn't happen before the voice stopped would keep its patch playing
+                        _patch.store(nullptr);
+                        _next_patch.store(nullptr);
+#endif
+                        return false;
+                    }
+                    
+                    for(std::uint32_t i = idx; !mixing && i < idx+span; ++i) {
+                        buffer[i] = 128;
+                    }
+                    
+                    skip(span);
+                    idx += span;
+                    _hold_count = 0;
+                    _hold_val = 0;
+                }
+                else if(_divider_shift == 0) {
+                    for(std::uint32_t end = idx+span; idx < end; ++idx) {
+                        std::uint8_t val = tick<generator>();
+                        buffer[idx] = mixing ? Audio::mix(buffer[idx], val) : val;
+                        AWSYNTH_TRACE_FIRST_SOUND(_audible, _channel, buffer, idx, val - 128);
+                        
+                        if(send) {
+                            send[idx] += ((val-128)*_send_Q8) >> 8;
+                        }
+                    }
+                }
+                else {
+                    // Callback is evaluated once per group of 2 or 4 samples, and the voice is advanced by the whole
+                    // group at once. Samples in between repeat the value or interpolate from the previous one.
+                    for(std::uint32_t end = idx+span; idx < end;) {
+                        if(_hold_count == 0) {
+                            _hold_prev = _hold_val;
+                            _hold_val = sample<generator>();
+                            _hold_count = 1 << _divider_shift;
+                        }
+                        
+                        std::uint32_t count = _hold_count < end-idx ? _hold_count : end-idx;
+                        skip(count);
+                        
+                        for(; count > 0; --count, ++idx) {
+                            --_hold_count;
+                            std::int32_t val = _hold_val;
+                            if(_interpolate) {
+                                val += ((_hold_prev - _hold_val) * _hold_count) >> _divider_shift;
+                            }
+                            buffer[idx] = mixing ? Audio::mix(buffer[idx], val + 128) : val + 128;
+                            AWSYNTH_TRACE_FIRST_SOUND(_audible, _channel, buffer, idx, val);
+                            
+                            if(send) {
+                                send[idx] += (val*_send_Q8) >> 8;
+                            }
+                        }
+                    }
+                }
+                
+                if(_cv_accu_Q20 <= 0) {
+                    _cv_accu_Q20 = _ONE_Q20;
+                    if constexpr(framed) {
+                        applyFrame(*frames++);
+                    }
+                    else {
+                        update();
+                    }
+                }
             }
+            
+            return true;
         }
         
-        template<std::uint32_t channel>
-        static void mix(std::uint8_t* buffer, void* ptr) {
+        // Sample time of the last buffer fill of a channel played with play(), for AWTriggers. Follows audio_playHead
+        // past its wrap-around, which works as long as some channel plays. Only written in the buffer fill.
+        static inline volatile std::uint32_t _fill_clock = 0;
+        
+        static inline void tickFillClock() {
+            std::uint32_t clock = _fill_clock;
+            _fill_clock = clock + ((audio_playHead - clock) & (512*bufferCount - 1));
+        }
+        
+        // Buffer fills of the voices played with play(). They are shared by all channels, and a voice that has faded
+        // out is disconnected from its own channel, like Audio::stop<channel>() does.
+        template<Generator generator>
+        static void copy(std::uint8_t* buffer, void* ptr) {
             auto& self = *reinterpret_cast<AWSynthSource*>(ptr);
-            for(uint32_t i = 0; i < 512; ++i) {
-                buffer[i] = Audio::mix(buffer[i], self.tick());
-            }
-            
-            if(self._volume_Q14 <= 0) {
-                Audio::stop<channel>();
+            AWSYNTH_TRACE(FILL_START, self._channel, audio_playHead);
+            tickFillClock();
+            if(!self.render<false, generator>(buffer)) {
+                AWSYNTH_TRACE(STOP, self._channel, 0);
+                Audio::connect(self._channel, nullptr, nullptr);
             }
+            AWSYNTH_TRACE(FILL_END, self._channel, audio_playHead);
         }
         
-        template<std::uint32_t channel>
-        static void mixAlt(std::uint8_t* buffer, void* ptr) {
+        template<Generator generator, bool sending=true>
+        static void mix(std::uint8_t* buffer, void* ptr) {
             auto& self = *reinterpret_cast<AWSynthSource*>(ptr);
-            for(uint32_t i = 0; i < 512; ++i) {
-                buffer[i] = Audio::mix(buffer[i], self.tickAlt());
+            AWSYNTH_TRACE(FILL_START, self._channel, audio_playHead);
+            if constexpr(sending) {
+                tickFillClock();    // Not for the low latency mix, which isn't a buffer fill
             }
-            
-            if(self._volume_Q14 <= 0) {
-                Audio::stop<channel>();
+            if(!self.render<true, generator, sending>(buffer)) {
+                AWSYNTH_TRACE(STOP, self._channel, 0);
+                Audio::connect(self._channel, nullptr, nullptr);
             }
+            AWSYNTH_TRACE(FILL_END, self._channel, audio_playHead);
         }
         
-        template<std::uint32_t channel>
+        template<Generator generator>
         static void lowLatencyMix(AWSynthSource& self) {
+            // Check if the last audio buffer has already been filled, and if so, add to it
             std::uint32_t idx = audio_playHead >> 9;
             std::uint32_t last = (idx - 1) & (bufferCount - 1);
             if(audio_state[last]) {
-                mix<channel>(audio_buffer + last*512, &self);
+                // The effects bus has already processed this buffer, so the voice is not sent to it
+                mix<generator, false>(audio_buffer + last*512, &self);
             }
         }
         
-        template<std::uint32_t channel>
-        static void lowLatencyMixAlt(AWSynthSource& self) {
-            // Check if the last audio buffer has already been filled, and if so, add to it
-            std::uint32_t idx = audio_playHead >> 9;
-            std::uint32_t last = (idx - 1) & (bufferCount - 1);
-            if(audio_state[last]) {
-                mixAlt<channel>(audio_buffer + last*512, &self);
+        // Connects a voice that has just started a note to 'channel', see AWPatch::start()
+        template<Generator generator>
+        static void start(AWSynthSource& self, std::uint32_t channel, bool lowLatency) {
+#ifdef PROJ_AWSYNTH_COMPACT
+            self._render = renderShared<generator>;
+            if(lowLatency) {
+                // Check if the last audio buffer has already been filled, and if so, add to it without sending
+                std::uint32_t idx = audio_playHead >> 9;
+                std::uint32_t last = (idx - 1) & (bufferCount - 1);
+                if(audio_state[last]) {
+                    self._render(self, audio_buffer + last*512, true, false);
+                }
+            }
+            
+            Audio::connect(channel, &self, process);
+#else
+            if(lowLatency) {
+                lowLatencyMix<generator>(self);
+            }
+            
+            Audio::connect(channel, &self, channel == 0 ? copy<generator> : mix<generator>);
+#endif
+        }
+
+#ifdef PROJ_AWSYNTH_HOTSWAP
+        template<typename Function>
+        static void forEachVoice(Function function) {
+#ifdef PROJ_AWSYNTH_COMPACT
+            for(unsigned channel = 0; channel < NUM_CHANNELS; ++channel) {
+                function(getInstance(channel));
             }
+#else
+            forEachVoice(function, std::make_integer_sequence<unsigned, NUM_CHANNELS>());
+#endif
         }
         
-        // Takes logarithmic level (0 to 1024) and returns gain as Q10 fixed point
-        static constexpr std::int32_t levelToGain(std::int32_t level) {
-            constexpr std::int32_t SCALE_Q15 = 3.32193*35/20 * (1<<15);   // 3.32193=log2(10); 35=scales level to 0...35 dB
-            return level > 0 ? (pow2(-((1024-level)*SCALE_Q15) >> 10) >> 5) : 0;
+        template<typename Function, unsigned... channels>
+        static void forEachVoice(Function function, std::integer_sequence<unsigned, channels...>) {
+            (function(getInstance<channels>()), ...);
         }
         
-        // Input range is -9...8.999 as Q15 fixed point
-        static constexpr std::uint32_t pow2(std::int32_t exp_Q15) {
-            std::uint32_t semitone_Q15 = 12 * (exp_Q15 & 0x7fff);
-            std::uint32_t semitone = semitone_Q15 >> 15;
-            std::uint32_t ratio_a_Q15 = _SEMITONES_Q15[semitone];
-            std::uint32_t ratio_b_Q15 = _SEMITONES_Q15[semitone + 1];
-            std::uint32_t fraction_Q15 = semitone_Q15 & 0x7fff;
+        // Takes the callback, envelopes, volume and timing of 'patch' into use, keeping envelope positions and phase
+        inline void swap(const AWPatch& patch) {
+            _patch.store(&patch);
+            
+            if(patch._data == nullptr) {
+                _callback = patch._callback;
+            }
+            else {
+                _callback_with_data = patch._callback_with_data;
+                _data = patch._state_init != nullptr ? _state : patch._data;
+            }
+            
+            _step_rate_Q24 = ((_CV_RATE_Q20<<4) + patch.step()-1) / (2*patch.step());
+            _step_div_Q24 = _ONE_Q24 / (2*patch.step());
+            
+            if(!_released) {
+                _volume_Q14 = percentToVolume(patch.volume());
+            }
+            Volume volume_Q14 = percentToVolume(patch.volume());
+            _release_rate_Q14 = patch.release() > 0 ? (volume_Q14 / (patch.release()*2*patch.step())) : volume_Q14;
+            
+            _levels = patch.amplitudes().data();
+            _levels_loop = patch.amplitudes().loop();
+            _levels_end = patch.amplitudes().end();
+            
+            _semitones = patch.semitones().data();
+            _semitones_loop = patch.semitones().loop();
+            _semitones_end = patch.semitones().end();
+            
+            if(!_fm_active && !_pluck_active) {
+                _unison = patch.unison();
+                for(std::uint32_t idx = 0; idx+1 < _unison; ++idx) {
+                    _unison_detune_Q16[idx] = (patch.detune() * _CENT_Q24 * _UNISON_SPREAD_Q8[idx]) >> 16;
+                }
+                detuneUnison();
+            }
             
-            std::uint32_t shift = 9 + (exp_Q15 >> 15);
-            return ((ratio_a_Q15 + (((ratio_b_Q15 - ratio_a_Q15) * fraction_Q15) >> 15)) << shift) >> 8;
+            send(patch.send());
+        }
+#endif
+        
+        // Takes the sample source from the patch and returns which generator plays it
+        inline Generator select(const AWPatch& patch) {
+            if(patch._pluck_init != nullptr) {
+                // Built-in plucked string voice
+                _callback = nullptr;
+                _data = nullptr;
+                return Generator::PLUCK;
+            }
+            else if(patch._fm_operators != nullptr) {
+                // Built-in FM voice
+                _fm_render = patch._fm_render;
+                _data = nullptr;
+                return Generator::FM;
+            }
+            else if(patch._state_init != nullptr) {
+                // Callback function with per-voice state
+                _callback_with_data = patch._callback_with_data;
+                _data = _state;
+                return Generator::WITH_DATA;
+            }
+            else if(patch._data == nullptr) {
+                // Plain callback function, no user data
+                _callback = patch._callback;
+                _data = nullptr;
+                return Generator::PLAIN;
+            }
+            else {
+                // Callback function with user data
+                _callback_with_data = patch._callback_with_data;
+                _data = patch._data;
+                return Generator::WITH_DATA;
+            }
+        }
+
+#ifdef PROJ_AWSYNTH_COMPACT
+        // Render loop shared by all channels, one per generator. The voice keeps the one of its patch.
+        template<Generator generator>
+        static bool renderShared(AWSynthSource& self, std::uint8_t* buffer, bool mixing, bool sending) {
+            return self.renderLoop<generator>(buffer, mixing, sending);
+        }
+        
+        static void process(std::uint8_t* buffer, void* ptr) {
+            auto& self = *reinterpret_cast<AWSynthSource*>(ptr);
+            
+            // Channel 0 is rendered first and overwrites the buffer, other channels are mixed into it
+            AWSYNTH_TRACE(FILL_START, self._channel, audio_playHead);
+            tickFillClock();
+            if(!self._render(self, buffer, self._channel != 0, true)) {
+                AWSYNTH_TRACE(STOP, self._channel, 0);
+                Audio::connect(self._channel, nullptr, nullptr);
+            }
+            AWSYNTH_TRACE(FILL_END, self._channel, audio_playHead);
+        }
+#endif
+        
+        // Takes logarithmic level (0 to 1.0) and returns gain
+        static constexpr Gain levelToGain(Fixed<12, 10> level) {
+            constexpr auto SCALE_Q15 = Fixed<19, 15>::fromRaw(3.32193*35/20 * (1<<15));   // 3.32193=log2(10); 35=scales level to 0...35 dB
+            return level > Level{} ? pow2((-((Fixed<12, 10>::one() - level)*SCALE_Q15)).to<15>()).to<10>().as<12, true>() : Gain{};
+        }
+        
+        // Input range is -9...8.999
+        static constexpr Fixed<25, 15, false> pow2(Exponent exp_Q15) {
+            auto semitone_Q15 = Fixed<19, 15, false>::fromRaw(exp_Q15.raw & 0x7fff) * 12;
+            std::uint32_t semitone = semitone_Q15.toInt();
+            auto ratio_a_Q15 = Fixed<16, 15, false>::fromRaw(_SEMITONES_Q15[semitone]);
+            auto ratio_b_Q15 = Fixed<16, 15, false>::fromRaw(_SEMITONES_Q15[semitone + 1]);
+            auto fraction_Q15 = Fixed<15, 15, false>::fromRaw(semitone_Q15.raw & 0x7fff);
+            
+            // Exponent's integer part can't be typed, so the result is shifted as a raw value
+            std::uint32_t shift = 9 + exp_Q15.toInt();
+            auto ratio_Q15 = ratio_a_Q15 + ((ratio_b_Q15 - ratio_a_Q15)*fraction_Q15).to<15>().as<16>();
+            return Fixed<25, 15, false>::fromRaw((static_cast<std::uint32_t>(ratio_Q15.raw) << shift) >> 8);
+        }
+        
+        // Phase increment of 'midikey' bent by 'pitchbend' octaves
+        static constexpr std::uint32_t rate(std::uint8_t midikey, Exponent pitchbend_Q15) {
+            return (_RATE_440HZ_Q32*pow2(_SEMITONE_SCALE_Q15*Fixed<8, 0>::fromInt(midikey-69) + pitchbend_Q15)).to<24>().raw;
+        }
+        
+        static constexpr Volume percentToVolume(std::uint8_t percent) {
+            return (Fixed<7, 0, false>::fromInt(percent < 100 ? percent : 100)*_PERCENT_Q30).to<14>();
+        }
+        
+        // Amplitude and pitch envelopes store values 0...31 and -32...31 semitones in the upper 6 bits
+        static constexpr Level envelopeLevel(std::int8_t val) {
+            return Fixed<6, 5>::fromRaw(val>>2).to<10>();
+        }
+        
+        static constexpr Pitch envelopePitch(std::int8_t val) {
+            return (Fixed<6, 0>::fromRaw(val>>2)*_SEMITONE_SCALE_Q15).to<10>().as<14>();
+        }
+        
+        // Moves an envelope cursor to the next step, looping or stopping past the end. Returns false if it had stopped.
+        static inline bool advanceEnvelope(std::uint8_t& idx, std::uint8_t loop, std::uint8_t end) {
+            std::uint32_t len = (end > 0 && end < AWPatch::Envelope::SIZE) ? end : AWPatch::Envelope::SIZE;
+            if(idx >= len) {
+                return false;
+            }
+            ++idx;
+            if(idx >= len) {
+                idx = (loop < end) ? loop : AWPatch::Envelope::SIZE;
+            }
+            return true;
+        }
+        
+        // Level and change over the step of level envelope step 'val'. A slide starts from 'level_Q10', the level the
+        // previous step ended at. The first step has no previous step, so it doesn't slide.
+        static inline void startLevel(std::int8_t val, Level level_Q10, bool first, Level& base_Q10, Level& delta_Q10) {
+            base_Q10 = envelopeLevel(val);
+            delta_Q10 = {};
+            
+            switch(static_cast<Effect>(val&3)) {
+                case Effect::ATTACK:
+                    delta_Q10 = base_Q10;
+                    base_Q10 = {};
+                    break;
+                
+                case Effect::DECAY:
+                    delta_Q10 = -base_Q10;
+                    break;
+                
+                case Effect::SLIDE:
+                    if(!first) {
+                        delta_Q10 = base_Q10 - level_Q10;
+                        base_Q10 = level_Q10;
+                    }
+                    break;
+                
+                default:
+                    break;
+            }
+        }
+        
+        // Same for pitch envelope step 'val'. A slide starts from 'base_Q10', the pitch of the previous step.
+        static inline void startPitch(std::int8_t val, bool first, Pitch& base_Q10, Pitch& delta_Q10) {
+            Pitch next_Q10 = envelopePitch(val);
+            delta_Q10 = {};
+            
+            switch(static_cast<Effect>(val&3)) {
+                case Effect::ATTACK:
+                    delta_Q10 = next_Q10;
+                    base_Q10 = {};
+                    break;
+                
+                case Effect::DECAY:
+                    delta_Q10 = -next_Q10;
+                    base_Q10 = next_Q10;
+                    break;
+                
+                case Effect::SLIDE:
+                    if(!first) {
+                        delta_Q10 = next_Q10 - base_Q10;
+                        break;
+                    }
+                    base_Q10 = next_Q10;
+                    break;
+                
+                default:
+                    base_Q10 = next_Q10;
+                    break;
+            }
+        }
+        
+        // Position 'accu_Q24' within an envelope step, and half of the step that 'div_Q24' covers
+        static constexpr Fraction stepFraction(std::int32_t accu_Q24) {
+            return Fixed<25, 24, false>::fromRaw(accu_Q24).to<20>();
+        }
+        
+        static constexpr Fixed<14, 15, false> halfStep(std::int32_t div_Q24) {
+            return Fixed<24, 25, false>::fromRaw(div_Q24).to<15>();
         }
         
         std::uint32_t _t;
@@ -594,35 +1523,258 @@ class AWSynthSource {
         std::uint8_t _levels_idx;
         std::uint8_t _levels_loop;
         std::uint8_t _levels_end;
-        std::int16_t _base_level_Q10;
-        std::int16_t _delta_level_Q10;
+        Level _base_level_Q10;
+        Level _delta_level_Q10;
         
         const std::int8_t* _semitones;
         std::uint8_t _semitones_idx;
         std::uint8_t _semitones_loop;
         std::uint8_t _semitones_end;
-        std::int16_t _base_pitchbend_Q10;
-        std::int16_t _delta_pitchbend_Q10;
+        Pitch _base_pitchbend_Q10;
+        Pitch _delta_pitchbend_Q10;
         
-        std::int16_t _target_gain_Q10;
-        std::int16_t _delta_gain_Q10;
+        Gain _target_gain_Q10;
+        Gain _delta_gain_Q10;
         
-        std::int16_t _release_rate_Q14;
-        std::int16_t _volume_Q14;
+        Volume _release_rate_Q14;
+        Volume _volume_Q14;
         
-        std::int16_t _glide_interval_Q10;
-        std::int16_t _glide_rate_Q14;
-        std::int16_t _glide_accu_Q14;
+        Glide _glide_interval_Q10;
+        GlideAccu _glide_rate_Q14;
+        GlideAccu _glide_accu_Q14;
         
         std::uint8_t _midikey;
         
         bool _released;
         
+        std::uint16_t _send_Q8;
+        
+        // Phases and rates of the additional unison oscillators
+        std::uint8_t _unison;
+        std::uint32_t _unison_p[AWPatch::MAX_UNISON-1];
+        std::uint32_t _unison_phase_Q24[AWPatch::MAX_UNISON-1];
+        std::uint32_t _unison_rate_Q24[AWPatch::MAX_UNISON-1];
+        std::int16_t _unison_detune_Q16[AWPatch::MAX_UNISON-1];
+        
+        // Render divider: callback is evaluated every 1<<_divider_shift samples, and the last value is held or interpolated
+        std::uint8_t _divider_shift;
+        bool _interpolate;
+        std::uint8_t _hold_count;
+        std::int16_t _hold_val;
+        std::int16_t _hold_prev;
+        
         union {
             std::int32_t (*_callback)(std::uint32_t, std::uint32_t);
             std::int32_t (*_callback_with_data)(std::uint32_t, std::uint32_t, void*);
+            AWFMRender _fm_render;
         };
         void* _data;
+        
+        // Per-voice state slot, holds the state of FM operators, a plucked string or a patch created with AWPatch::withState()
+        alignas(std::max_align_t) std::uint8_t _state[AWPatch::STATE_SIZE];
+        const AWPatch* _state_owner;
+        bool _fm_active;
+        bool _pluck_active;
+        
+        // Channel the voice was last played on, which it disconnects from when it has faded out
+        std::uint8_t _channel = 0;
+#ifdef PROJ_AWSYNTH_COMPACT
+        bool (*_render)(AWSynthSource& self, std::uint8_t* buffer, bool mixing, bool sending) = nullptr;
+#endif
+#ifdef PROJ_AWSYNTH_TRACE
+        bool _audible = false;
+#endif
+#ifdef PROJ_AWSYNTH_HOTSWAP
+        // Patch that is playing, or nullptr once the voice has faded out, and the patch to switch to at the next control
+        // value update. Atomic, as the watcher of the patch files reads them while the audio thread renders.
+        std::atomic<const AWPatch*> _patch{nullptr};
+        std::atomic<const AWPatch*> _next_patch{nullptr};
+#endif
+        
+        static_assert(sizeof(AWFMState) <= AWPatch::STATE_SIZE, "FM voice state doesn't fit, increase PROJ_AWSYNTH_VOICE_STATE_SIZE");
+        static_assert(sizeof(AWPluckState) <= AWPatch::STATE_SIZE, "Plucked voice state doesn't fit, increase PROJ_AWSYNTH_VOICE_STATE_SIZE");
+        
+        inline AWFMState& fm() { return *reinterpret_cast<AWFMState*>(_state); }
+        inline AWPluckState& pluck() { return *reinterpret_cast<AWPluckState*>(_state); }
 };
 
+inline void AWPluckState::init(void* slot, const void* owner, std::uint32_t rate_Q24) {
+    auto& self = *new (slot) AWPluckState();
+    
+    std::uint32_t length = MAX_LENGTH;
+    while(length > MIN_LENGTH && static_cast<std::uint64_t>(rate_Q24)*length > ((1<<24)*181ull >> 7)) {
+        length >>= 1;
+    }
+    
+    for(; length >= MIN_LENGTH; length >>= 1) {
+        if(Block* block = allocate(owner, length)) {
+            self.buffer = _pool + block->start;
+            self.block = block;
+            self.shift = 8;
+            for(std::uint32_t len = length; len > 1; len >>= 1) {
+                --self.shift;
+            }
+            
+            // Averaging keeps any DC offset forever, so the mean of the noise burst is removed
+            _seed += length;
+            std::int32_t sum = 0;
+            for(std::uint32_t idx = 0; idx < length; ++idx) {
+                std::int32_t val = AWSynthSource::noise((_seed + idx) << 7);
+                self.buffer[idx] = val;
+                sum += val;
+            }
+            std::int32_t mean = sum / static_cast<std::int32_t>(length);
+            for(std::uint32_t idx = 0; idx < length; ++idx) {
+                std::int32_t val = self.buffer[idx] - mean;
+                self.buffer[idx] = val > -128 ? (val < 127 ? val : 127) : -128;
+            }
+            return;
+        }
+    }
+    
+    // Pool is full. The voice stays silent, reading a single zero entry.
+    self.buffer = &_silence;
+}
+
+template<AWPatch::Generator generator>
+inline void AWPatch::start(AWSynthSource& voice, std::uint32_t channel, bool lowLatency) {
+    AWSynthSource::start<generator>(voice, channel, lowLatency);
+}
+
+// Set of voices with its own mixer and sample clock, rendered into buffers given by the caller instead of the LibAudio
+// channels. Lets the desktop build, offline tools and tests run several independent synths, e.g. one per song.
+//     Audio::AWEngine<8> engine;
+//     engine.play(0, patch, 60);
+//     engine.render(buffer);      // Next 512 samples of all voices
+// Thread safety: an engine is not locked, so play(), release() and render() of one engine must not run at the same
+// time. Separate engines share no state and can render on separate threads, except for:
+// - plucked patches, whose delay lines come from one pool shared by all voices
+// - user data and callback state shared by every voice that plays the same patch
+// - the trace ring buffer when PROJ_AWSYNTH_TRACE is defined
+// Voices of an engine are not sent to the effects bus, which belongs to the LibAudio mixer.
+template<unsigned Voices>
+class AWEngine {
+    
+    static_assert(Voices > 0, "Engine needs at least one voice");
+    
+    friend class AWSynthSource;
+    
+    public:
+        
+        static constexpr std::uint32_t BUFFER_SIZE = 512;
+        
+        // Engine that owns the voices played through the LibAudio channels by AWSynthSource::play<channel>(). They are
+        // rendered in the audio interrupt, so render() and isPlaying() are only used with it when nothing else fills the
+        // LibAudio buffers, like in AWLoadTest.h.
+        static AWEngine& getDefault() {
+            static_assert(Voices == NUM_CHANNELS, "Default engine has one voice per channel");
+            static AWEngine engine;
+            return engine;
+        }
+        
+        inline AWSynthSource& voice(unsigned idx) { return _voices[idx]; }
+        
+        // Starts a note on voice 'idx'. The returned voice can be released or sent to later.
+        AWSynthSource& play(unsigned idx, const AWPatch& patch, std::uint8_t midikey=48) {
+            auto& voice = _voices[idx];
+            voice._channel = idx;
+            voice.init(patch, midikey);
+            _generators[idx] = voice.select(patch);
+            _playing[idx] = true;
+            return voice;
+        }
+        
+        inline void release(unsigned idx) { _voices[idx].release(); }
+        
+        // Returns false once the voice has faded out after its release
+        inline bool isPlaying(unsigned idx) const { return _playing[idx]; }
+        
+        // Number of samples rendered so far
+        inline std::uint64_t clock() const { return _clock; }
+        
+        // Renders the next BUFFER_SIZE samples of all playing voices, mixed together as unsigned 8-bit samples
+        void render(std::uint8_t* buffer) {
+            // Voices are mixed into silence, which gives the same samples as overwriting the buffer with the first one
+            for(std::uint32_t i = 0; i < BUFFER_SIZE; ++i) {
+                buffer[i] = 128;
+            }
+            for(unsigned idx = 0; idx < Voices; ++idx) {
+                if(_playing[idx]) {
+                    _playing[idx] = renderVoice(idx, buffer);
+                }
+            }
+            _clock += BUFFER_SIZE;
+        }
+    
+    private:
+        
+        using Generator = AWSynthSource::Generator;
+        
+        bool renderVoice(unsigned idx, std::uint8_t* buffer) {
+            auto& voice = _voices[idx];
+            switch(_generators[idx]) {
+                case Generator::FM:
+                    return voice.template render<true, Generator::FM, false>(buffer);
+                
+                case Generator::PLUCK:
+                    return voice.template render<true, Generator::PLUCK, false>(buffer);
+                
+                case Generator::WITH_DATA:
+                    return voice.template render<true, Generator::WITH_DATA, false>(buffer);
+                
+                default:
+                    return voice.template render<true, Generator::PLAIN, false>(buffer);
+            }
+        }
+        
+        AWSynthSource _voices[Voices];
+        Generator _generators[Voices] = {};
+        bool _playing[Voices] = {};
+        std::uint64_t _clock = 0;
+};
+
+template<unsigned channel>
+inline AWSynthSource& AWSynthSource::getInstance() {
+    static_assert(channel < NUM_CHANNELS);
+    return AWEngine<>::getDefault().voice(channel);
+}
+
+template<unsigned channel, bool lowLatency>
+inline AWSynthSource& AWSynthSource::play(const AWPatch& patch, std::uint8_t midikey) {
+    static_assert(!AWEffectsBus::reserves(channel), "Channel is used by the effects bus");
+
+#ifdef PROJ_AWSYNTH_COMPACT
+    return play(channel, lowLatency, patch, midikey);
+#else
+    AWSYNTH_TRACE(PLAY, channel, audio_playHead);
+    
+    auto& self = AWEngine<>::getDefault().play(channel, patch, midikey);
+    AWSYNTH_TRACE(INIT, channel, 0);
+    
+    // Only the render loops of the kinds of patches the program builds are linked in, see AWPatch::start()
+    patch._start(self, channel, lowLatency);
+    return self;
+#endif
+}
+
+#ifdef PROJ_AWSYNTH_COMPACT
+inline AWSynthSource& AWSynthSource::getInstance(unsigned channel) {
+    return AWEngine<>::getDefault().voice(channel);
+}
+
+inline AWSynthSource& AWSynthSource::play(unsigned channel, bool lowLatency, const AWPatch& patch, std::uint8_t midikey) {
+    if(AWEffectsBus::reserves(channel)) {
+        return getInstance(channel);    // Channel is used by the effects bus, so the note is not played
+    }
+    
+    AWSYNTH_TRACE(PLAY, channel, audio_playHead);
+    
+    auto& self = AWEngine<>::getDefault().play(channel, patch, midikey);
+    AWSYNTH_TRACE(INIT, channel, 0);
+    
+    patch._start(self, channel, lowLatency);
+    return self;
+}
+#endif
+
 } // namespace Audio
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <LibAudio>
+
+// Trace points of AWSynth voices. With PROJ_AWSYNTH_TRACE defined, events are logged with a timestamp into a fixed ring
+// buffer, which can be printed with AWTrace::dump() and decoded with scripts/AWTraceDecode.py. Otherwise the trace
+// points expand to nothing. Control value updates happen about 240 times per second per voice and would push the other
+// events out of the ring buffer, so they are only logged if PROJ_AWSYNTH_TRACE_UPDATES is defined as well.
+
+#ifdef PROJ_AWSYNTH_TRACE
+
+#ifndef PROJ_AWSYNTH_TRACE_SIZE
+#define PROJ_AWSYNTH_TRACE_SIZE 256
+#endif
+
+#ifdef POKITTO
+#include "us_ticker_api.h"
+#else
+#include <chrono>
+#endif
+
+#include <cstdio>
+
+#define AWSYNTH_TRACE(event, channel, arg) Audio::AWTrace::log(Audio::AWTrace::Event::event, (channel), (arg))
+
+#ifdef PROJ_AWSYNTH_TRACE_UPDATES
+#define AWSYNTH_TRACE_UPDATE(channel) AWSYNTH_TRACE(UPDATE, channel, 0)
+#else
+#define AWSYNTH_TRACE_UPDATE(channel)
+#endif
+
+// Logs the first non-zero sample 'val' of a voice, written to buffer[idx]. 'flag' is set so that only the first one is
+// logged.
+#define AWSYNTH_TRACE_FIRST_SOUND(flag, channel, buffer, idx, val) \
+    do { \
+        if(!(flag) && (val) != 0) { \
+            (flag) = true; \
+            AWSYNTH_TRACE(FIRST_SOUND, channel, Audio::AWTrace::position((buffer), (idx))); \
+        } \
+    } while(0)
+
+namespace Audio {
+
+class AWTrace {
+    
+    public:
+        
+        // Number of events kept, must be a power of two
+        static constexpr std::uint32_t SIZE = PROJ_AWSYNTH_TRACE_SIZE;
+        static_assert((SIZE & (SIZE-1)) == 0, "PROJ_AWSYNTH_TRACE_SIZE must be a power of two");
+        
+        enum struct Event : std::uint8_t {
+            PLAY,           // play() was called, 'arg' is audio_playHead
+            INIT,           // Voice has been initialized
+            FIRST_SOUND,    // First non-silent sample, 'arg' is its position in audio_buffer or NO_POSITION
+            UPDATE,         // Control values were updated, only with PROJ_AWSYNTH_TRACE_UPDATES
+            RELEASE,        // Release was triggered by release() or by the end of the level envelope
+            STOP,           // Voice faded out and was disconnected
+            FILL_START,     // Voice starts rendering a buffer, 'arg' is audio_playHead
+            FILL_END        // Voice finished rendering a buffer, 'arg' is audio_playHead
+        };
+        
+        // Position of samples rendered outside audio_buffer, e.g. into the buffer of an AWEngine or ahead of time
+        static constexpr std::uint16_t NO_POSITION = 0xFFFF;
+        
+        static inline std::uint16_t position(const std::uint8_t* buffer, std::uint32_t idx) {
+            std::uint32_t offset = buffer + idx - audio_buffer;
+            return offset < 512*bufferCount ? offset : NO_POSITION;
+        }
+        
+        struct Entry {
+            std::uint32_t time_us;
+            Event event;
+            std::uint8_t channel;
+            std::uint16_t arg;
+        };
+        
+        // Events may be logged from the audio interrupt and from the main loop. An entry can be torn if both write at
+        // the same moment, which is acceptable for a debugging aid.
+        static inline void log(Event event, std::uint32_t channel, std::uint32_t arg) {
+            std::uint32_t idx = _count++ & (SIZE-1);
+            _entries[idx] = {now(), event, static_cast<std::uint8_t>(channel), static_cast<std::uint16_t>(arg)};
+        }
+        
+        // Prints the logged events, oldest first, as text lines for scripts/AWTraceDecode.py
+        static void dump() {
+            std::uint32_t count = _count;
+            std::uint32_t first = count > SIZE ? count - SIZE : 0;
+            
+            std::printf("# AWTrace rate=%u buffers=%u size=512 lost=%u\n",
+                static_cast<unsigned>(POK_AUD_FREQ), static_cast<unsigned>(bufferCount), static_cast<unsigned>(first));
+            for(std::uint32_t idx = first; idx < count; ++idx) {
+                const Entry& entry = _entries[idx & (SIZE-1)];
+                std::printf("%u %u %u %u\n",
+                    static_cast<unsigned>(entry.time_us), static_cast<unsigned>(entry.event),
+                    static_cast<unsigned>(entry.channel), static_cast<unsigned>(entry.arg));
+            }
+        }
+        
+        static void clear() { _count = 0; }
+    
+    private:
+        
+        static inline std::uint32_t now() {
+#ifdef POKITTO
+            return us_ticker_read();
+#else
+            using namespace std::chrono;
+            return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+        
+        static inline volatile std::uint32_t _count = 0;
+        static inline Entry _entries[SIZE] = {};
+};
+
+} // namespace Audio
+
+#else
+
+#define AWSYNTH_TRACE(event, channel, arg)
+#define AWSYNTH_TRACE_UPDATE(channel)
+#define AWSYNTH_TRACE_FIRST_SOUND(flag, channel, buffer, idx, val)
+
+#endif
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+#include <LibAudio>
+#include "AWSynthSource.h"
+
+// Trigger layer in front of AWSynthSource::play(). Game logic often plays the same sound several times in one frame,
+// and every play() restarts the voice and mixes it again into the last filled buffer, which costs time and clicks.
+// AWTriggers::play() merges a trigger into the voice that is already playing the same patch and key, if that was
+// triggered less than window() ago, and drops triggers that would exceed the limits set for their patch. It returns
+// the voice that plays the note, or nullptr if the trigger was dropped. Usage:
+//     Audio::AWTriggers::limit(coin_patch, 2, 50);        // At most two coins at once, 50 ms apart
+//     if(auto* voice = Audio::AWTriggers::play<1>(coin_patch, 60)) voice->send(20);
+//     Audio::AWTriggers::update();                         // In the main loop, e.g. once per frame
+// Times are kept in samples of the audio clock, which the buffer fill of the AWSynthSource channels advances along
+// audio_playHead. audio_playHead wraps around every bufferCount buffers, so when no channel is playing, play() or
+// update() must be called more often than that. Call only from the main loop, and don't play the same channels with
+// AWSynthSource::play() meanwhile.
+
+namespace Audio {
+
+class AWTriggers {
+    
+    public:
+        
+        static constexpr std::uint32_t MAX_LIMITS = 8;
+        
+        static AWTriggers& getInstance() {
+            static AWTriggers self;
+            return self;
+        }
+        
+        // Triggers of the same patch and key less than 'ms' milliseconds apart play one note. Zero disables merging.
+        static void window(std::uint32_t ms) { getInstance()._window = toSamples(ms); }
+        
+        // Limits 'patch' to 'instances' audible voices at once, started at least 'interval_ms' milliseconds apart.
+        // Zero leaves that limit out. Returns false if MAX_LIMITS patches are limited already.
+        static bool limit(const AWPatch& patch, std::uint8_t instances, std::uint32_t interval_ms=0) {
+            auto& self = getInstance();
+            Limit* free = nullptr;
+            for(auto& entry : self._limits) {
+                if(entry.patch == &patch) {
+                    free = &entry;
+                    break;
+                }
+                if(entry.patch == nullptr && free == nullptr) {
+                    free = &entry;
+                }
+            }
+            if(free == nullptr) {
+                return false;
+            }
+            
+            *free = {&patch, instances, toSamples(interval_ms)};
+            return true;
+        }
+        
+        static void clearLimit(const AWPatch& patch) {
+            for(auto& entry : getInstance()._limits) {
+                if(entry.patch == &patch) {
+                    entry = {};
+                }
+            }
+        }
+        
+        template<unsigned channel=0, bool lowLatency=true>
+        static AWSynthSource* play(const AWPatch& patch, std::uint8_t midikey=48) {
+            static_assert(channel < NUM_CHANNELS);
+            
+            auto& self = getInstance();
+            AWSynthSource* voice = nullptr;
+            if(self.admit(channel, patch, midikey, voice) != Verdict::PLAY) {
+                return voice;
+            }
+            voice = &AWSynthSource::play<channel, lowLatency>(patch, midikey);
+            self._notes[channel] = {&patch, midikey, self._now};
+            return voice;
+        }
+
+#ifdef PROJ_AWSYNTH_COMPACT
+        // Same as above, but channel and latency are given at runtime
+        static AWSynthSource* play(unsigned channel, bool lowLatency, const AWPatch& patch, std::uint8_t midikey=48) {
+            auto& self = getInstance();
+            AWSynthSource* voice = nullptr;
+            if(self.admit(channel, patch, midikey, voice) != Verdict::PLAY) {
+                return voice;
+            }
+            voice = &AWSynthSource::play(channel, lowLatency, patch, midikey);
+            self._notes[channel] = {&patch, midikey, self._now};
+            return voice;
+        }
+#endif
+        
+        // Follows the audio clock. Call from the main loop when there may be no triggers or sound for a while.
+        static void update() { getInstance().now(); }
+        
+        // Numbers of triggers merged into a playing voice and dropped by the limits since the last resetCounts()
+        static std::uint32_t merged() { return getInstance()._merged; }
+        static std::uint32_t dropped() { return getInstance()._dropped; }
+        
+        static void resetCounts() {
+            auto& self = getInstance();
+            self._merged = 0;
+            self._dropped = 0;
+        }
+    
+    private:
+        
+        enum struct Verdict : std::uint8_t { PLAY, MERGED, DROPPED };
+        
+        struct Limit {
+            const AWPatch* patch;
+            std::uint8_t instances;
+            std::uint32_t interval;
+        };
+        
+        // Last note started on each channel
+        struct Note {
+            const AWPatch* patch;
+            std::uint8_t midikey;
+            std::uint32_t time;
+        };
+        
+        static constexpr std::uint32_t toSamples(std::uint32_t ms) {
+            return static_cast<std::uint64_t>(ms) * POK_AUD_FREQ / 1000;
+        }
+        
+        // Voice is heard until its release has faded out or its envelope stays at zero
+        static bool audible(const AWSynthSource& voice) {
+            return voice._volume_Q14 > AWSynthSource::Volume{} &&
+                   (voice._target_gain_Q10 != AWSynthSource::Gain{} || voice._delta_gain_Q10 != AWSynthSource::Gain{});
+        }
+        
+        // Current time of the audio clock in samples. Both the buffer fill and this follow audio_playHead, and either
+        // misses a wrap-around only if it doesn't run for a whole ring of buffers, so the later time of the two is taken.
+        std::uint32_t now() {
+            std::uint32_t head, filled;
+            do {
+                filled = AWSynthSource::_fill_clock;
+                head = audio_playHead;
+            } while(filled != AWSynthSource::_fill_clock);     // Buffer was filled in between
+            
+            constexpr std::uint32_t MASK = 512*bufferCount - 1;
+            std::uint32_t time = _now + ((head - _now) & MASK);
+            std::uint32_t fill_time = filled + ((head - filled) & MASK);
+            if(static_cast<std::int32_t>(fill_time - time) > 0) {
+                time = fill_time;
+            }
+            _now = time;
+            return _now;
+        }
+        
+        // Decides what to do with a trigger. A merged trigger gets the voice that already plays its note in 'merged'.
+        // Only a voice that is still heard and held takes triggers, as a released one would drop them.
+        Verdict admit(unsigned channel, const AWPatch& patch, std::uint8_t midikey, AWSynthSource*& merged) {
+            std::uint32_t time = now();
+            
+            for(unsigned idx = 0; idx < NUM_CHANNELS; ++idx) {
+                const auto& note = _notes[idx];
+                if(note.patch == &patch && note.midikey == midikey && time - note.time < _window &&
+                   audible(voice(idx)) && !voice(idx)._released) {
+                    ++_merged;
+                    merged = &voice(idx);
+                    return Verdict::MERGED;
+                }
+            }
+            
+            Verdict verdict = Verdict::PLAY;
+            for(const auto& entry : _limits) {
+                if(entry.patch != &patch) {
+                    continue;
+                }
+                
+                // The note on 'channel' is cut off by this one, so it doesn't count
+                std::uint32_t instances = 0;
+                for(unsigned idx = 0; idx < NUM_CHANNELS; ++idx) {
+                    const auto& note = _notes[idx];
+                    if(note.patch != &patch) {
+                        continue;
+                    }
+                    if(time - note.time < entry.interval) {
+                        verdict = Verdict::DROPPED;
+                    }
+                    instances += idx != channel && audible(voice(idx));
+                }
+                if(entry.instances > 0 && instances >= entry.instances) {
+                    verdict = Verdict::DROPPED;
+                }
+                break;
+            }
+            
+            _dropped += verdict == Verdict::DROPPED;
+            return verdict;
+        }
+        
+        static AWSynthSource& voice(unsigned channel) { return AWEngine<>::getDefault().voice(channel); }
+        
+        std::uint32_t _window = toSamples(20);      // Just over one frame at 60 fps
+        Limit _limits[MAX_LIMITS] = {};
+        Note _notes[NUM_CHANNELS] = {};
+        
+        std::uint32_t _now = 0;
+        
+        std::uint32_t _merged = 0;
+        std::uint32_t _dropped = 0;
+};
+
+} // namespace Audio
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <cstdint>
+#include "AWSynthSource.h"
+
+// Bank of voices that keeps its voice state as arrays, one per field, instead of one AWSynthSource object per voice.
+// All voices of a bank share one control clock. Their control values are updated together in one loop, and then each
+// voice renders its samples up to the next update. With many voices the update reads envelope cursors, gains and
+// rates from a few tightly packed arrays, and the loop overhead is paid once per control period instead of per voice.
+//     static Audio::AWVoiceBank<16> bank;
+//     bank.play(3, patch, 60);
+//     bank.render(buffer);        // Next 512 samples of all voices
+// Plays callback patches with or without shared user data. Patches with per-voice state, FM, plucked strings, unison
+// or a render divider need the state of a whole AWSynthSource and are not played. Like AWEngine, a bank isn't locked
+// and its voices are not sent to the effects bus.
+
+namespace Audio {
+
+template<unsigned Voices>
+class AWVoiceBank {
+    
+    static_assert(Voices > 0, "Bank needs at least one voice");
+    
+    public:
+        
+        static constexpr std::uint32_t BUFFER_SIZE = 512;
+        
+        // Starts a note on voice 'idx'. It is heard from the next render(). Returns false if the patch needs features
+        // that the bank doesn't have.
+        bool play(unsigned idx, const AWPatch& patch, std::uint8_t midikey=48) {
+            if(patch._fm_operators != nullptr || patch._pluck_init != nullptr || patch._state_init != nullptr ||
+               patch.unison() > 1 || patch.divider() > 1) {
+                return false;
+            }
+            
+            const bool legato = patch.glide() > 0 && _active[idx] && !_released[idx];
+            if(legato) {
+                // Remaining glide interval of the previous note, and the interval from this to the previous midikey
+                _glide_interval_Q10[idx] = (_glide_interval_Q10[idx]*_glide_accu_Q14[idx]).template to<10>().template as<15>();
+                _glide_interval_Q10[idx] += Glide::fromInt(_midikey[idx]-midikey) / 12;
+                _glide_rate_Q14[idx] = GlideAccu::one() / (patch.glide()*patch.step());
+                _glide_accu_Q14[idx] = GlideAccu::one();
+            }
+            else {
+                _t[idx] = 0;
+                _p[idx] = 0;
+                _phase_Q24[idx] = 0;
+                
+                _step_rate_Q24[idx] = ((AWSynthSource::_CV_RATE_Q20<<4) + patch.step()-1) / (2*patch.step());
+                _step_div_Q24[idx] = AWSynthSource::_ONE_Q24 / (2*patch.step());
+                _step_accu_Q24[idx] = 0;
+                
+                _volume_Q14[idx] = AWSynthSource::percentToVolume(patch.volume());
+                _release_rate_Q14[idx] = patch.release() > 0 ? (_volume_Q14[idx] / (patch.release()*2*patch.step())) : _volume_Q14[idx];
+                
+                _levels[idx] = patch.amplitudes().data();
+                _levels_loop[idx] = patch.amplitudes().loop();
+                _levels_end[idx] = patch.amplitudes().end();
+                _levels_idx[idx] = 0;
+                AWSynthSource::startLevel(_levels[idx][0], Level{}, true, _base_level_Q10[idx], _delta_level_Q10[idx]);
+                
+                Level level_Q10 = _base_level_Q10[idx] + (_delta_level_Q10[idx]*AWSynthSource::stepFraction(_step_div_Q24[idx])).template to<10>().template as<11>();
+                _target_gain_Q10[idx] = AWSynthSource::levelToGain((_volume_Q14[idx]*level_Q10).template to<10>());
+                _delta_gain_Q10[idx] = _target_gain_Q10[idx];
+                
+                _semitones[idx] = patch.semitones().data();
+                _semitones_loop[idx] = patch.semitones().loop();
+                _semitones_end[idx] = patch.semitones().end();
+                _semitones_idx[idx] = 0;
+                AWSynthSource::startPitch(_semitones[idx][0], true, _base_pitchbend_Q10[idx], _delta_pitchbend_Q10[idx]);
+                
+                Exponent pitchbend_Q15 = _base_pitchbend_Q10[idx].template to<15>() + (_delta_pitchbend_Q10[idx]*AWSynthSource::halfStep(_step_div_Q24[idx])).template to<15>();
+                _rate_Q24[idx] = AWSynthSource::rate(midikey, pitchbend_Q15);
+                
+                _glide_interval_Q10[idx] = {};
+                _glide_rate_Q14[idx] = {};
+                _glide_accu_Q14[idx] = {};
+            }
+            
+            if(patch._data == nullptr) {
+                _callbacks[idx].plain = patch._callback;
+            }
+            else {
+                _callbacks[idx].with_data = patch._callback_with_data;
+            }
+            _data[idx] = patch._data;
+            
+            _midikey[idx] = midikey;
+            _released[idx] = false;
+            _active[idx] = true;
+            return true;
+        }
+        
+        inline void release(unsigned idx) { _released[idx] = true; }
+        
+        // Returns false once the voice has faded out after its release
+        inline bool isPlaying(unsigned idx) const { return _active[idx]; }
+        
+        // Number of samples rendered so far
+        inline std::uint64_t clock() const { return _clock; }
+        
+        // Renders the next BUFFER_SIZE samples of all playing voices, mixed together as unsigned 8-bit samples
+        void render(std::uint8_t* buffer) {
+            for(std::uint32_t i = 0; i < BUFFER_SIZE; ++i) {
+                buffer[i] = 128;
+            }
+            
+            std::uint32_t idx = 0;
+            while(idx < BUFFER_SIZE) {
+                // Number of samples until the next control value update
+                std::uint32_t span = (_cv_accu_Q20 + AWSynthSource::_CV_RATE_Q20 - 1) / AWSynthSource::_CV_RATE_Q20;
+                span = span < BUFFER_SIZE-idx ? span : BUFFER_SIZE-idx;
+                
+                for(unsigned voice = 0; voice < Voices; ++voice) {
+                    if(_active[voice]) {
+                        renderSpan(voice, buffer + idx, span);
+                    }
+                }
+                
+                _cv_accu_Q20 -= span*AWSynthSource::_CV_RATE_Q20;
+                idx += span;
+                if(_cv_accu_Q20 <= 0) {
+                    _cv_accu_Q20 = AWSynthSource::_ONE_Q20;
+                    update();
+                }
+            }
+            _clock += BUFFER_SIZE;
+        }
+    
+    private:
+        
+        using Level = AWSynthSource::Level;
+        using Pitch = AWSynthSource::Pitch;
+        using Gain = AWSynthSource::Gain;
+        using Volume = AWSynthSource::Volume;
+        using Glide = AWSynthSource::Glide;
+        using GlideAccu = AWSynthSource::GlideAccu;
+        using Exponent = AWSynthSource::Exponent;
+        using Fraction = AWSynthSource::Fraction;
+        
+        union Callback {
+            std::int32_t (*plain)(std::uint32_t, std::uint32_t);
+            std::int32_t (*with_data)(std::uint32_t, std::uint32_t, void*);
+        };
+        
+        // Renders 'span' samples of 'voice' into 'buffer'. Gain is interpolated toward the target of the next update.
+        void renderSpan(unsigned voice, std::uint8_t* buffer, std::uint32_t span) {
+            Gain target_Q10 = _target_gain_Q10[voice];
+            Gain delta_Q10 = _delta_gain_Q10[voice];
+            std::uint32_t phase_Q24 = _phase_Q24[voice];
+            std::uint32_t rate_Q24 = _rate_Q24[voice];
+            std::int32_t step_accu_Q24 = _step_accu_Q24[voice];
+            std::int32_t step_rate_Q24 = _step_rate_Q24[voice];
+            
+            if(target_Q10 != Gain{} || delta_Q10 != Gain{}) {
+                Callback callback = _callbacks[voice];
+                void* data = _data[voice];
+                std::uint32_t t0 = _t[voice];
+                std::uint32_t p0 = _p[voice];
+                std::int32_t cv_accu_Q20 = _cv_accu_Q20;
+                
+                for(std::uint32_t i = 0; i < span; ++i) {
+                    Gain gain_Q10 = target_Q10 - (delta_Q10*Fraction::fromRaw(cv_accu_Q20).to<16>()).to<10>().as<12>();
+                    std::uint32_t t = t0 + (step_accu_Q24>>16);
+                    std::uint32_t p = p0 + (phase_Q24>>16);
+                    
+                    std::int32_t val = data == nullptr ? callback.plain(t, p) : callback.with_data(t, p, data);
+                    val = (Fixed<18, 0>::fromRaw(val)*gain_Q10).toInt();
+                    val = val > -128 ? (val < 127 ? val : 127) : -128;
+                    buffer[i] = Audio::mix(buffer[i], val + 128);
+                    
+                    step_accu_Q24 += step_rate_Q24;
+                    phase_Q24 += rate_Q24;
+                    cv_accu_Q20 -= AWSynthSource::_CV_RATE_Q20;
+                }
+            }
+            else {
+                // Gain is zero for the whole span, so only the position moves on
+                step_accu_Q24 += span*step_rate_Q24;
+                phase_Q24 += span*rate_Q24;
+            }
+            
+            _phase_Q24[voice] = phase_Q24;
+            _step_accu_Q24[voice] = step_accu_Q24;
+        }
+        
+        // Control value update of all voices. Same as AWSynthSource::update(), one field array at a time.
+        void update() {
+            for(unsigned voice = 0; voice < Voices; ++voice) {
+                if(!_active[voice]) {
+                    continue;
+                }
+                
+                _p[voice] += _phase_Q24[voice]>>(24-8);
+                _phase_Q24[voice] &= (1<<(24-8)) - 1;
+                
+                if(_released[voice]) {
+                    _volume_Q14[voice] -= _release_rate_Q14[voice];
+                    if(_volume_Q14[voice] <= Volume{}) {
+                        _volume_Q14[voice] = {};
+                    }
+                }
+                
+                Level level_Q10 = _base_level_Q10[voice];
+                Exponent pitchbend_Q15 = _base_pitchbend_Q10[voice].template to<15>();
+                
+                if(_step_accu_Q24[voice]+_step_div_Q24[voice] >= AWSynthSource::_ONE_Q24) {
+                    _step_accu_Q24[voice] = -_step_div_Q24[voice];
+                    _t[voice] += 256;
+                    
+                    level_Q10 += _delta_level_Q10[voice];
+                    _delta_level_Q10[voice] = {};
+                    
+                    if(AWSynthSource::advanceEnvelope(_levels_idx[voice], _levels_loop[voice], _levels_end[voice])) {
+                        if(_levels_idx[voice] < AWPatch::Envelope::SIZE) {
+                            AWSynthSource::startLevel(_levels[voice][_levels_idx[voice]], level_Q10, false, _base_level_Q10[voice], _delta_level_Q10[voice]);
+                            if(_base_level_Q10[voice] < level_Q10) {
+                                level_Q10 = _base_level_Q10[voice];
+                            }
+                        }
+                        else {
+                            _base_level_Q10[voice] = level_Q10;
+                            if(!_released[voice]) {
+                                _released[voice] = true;    // Release starts at the end of the level envelope
+                                if(_release_rate_Q14[voice] >= _volume_Q14[voice]) {
+                                    _volume_Q14[voice] = {};
+                                }
+                            }
+                        }
+                    }
+                    
+                    pitchbend_Q15 += _delta_pitchbend_Q10[voice].template to<15>() - (_delta_pitchbend_Q10[voice]*AWSynthSource::halfStep(_step_div_Q24[voice])).template to<15>();
+                    
+                    _base_pitchbend_Q10[voice] += _delta_pitchbend_Q10[voice];
+                    _delta_pitchbend_Q10[voice] = {};
+                    
+                    if(AWSynthSource::advanceEnvelope(_semitones_idx[voice], _semitones_loop[voice], _semitones_end[voice]) &&
+                       _semitones_idx[voice] < AWPatch::Envelope::SIZE) {
+                        AWSynthSource::startPitch(_semitones[voice][_semitones_idx[voice]], false, _base_pitchbend_Q10[voice], _delta_pitchbend_Q10[voice]);
+                    }
+                }
+                else {
+                    level_Q10 += (_delta_level_Q10[voice]*AWSynthSource::stepFraction(_step_accu_Q24[voice] + _step_div_Q24[voice])).template to<10>().template as<11>();
+                    pitchbend_Q15 += (_delta_pitchbend_Q10[voice]*Fixed<26, 24>::fromRaw(_step_accu_Q24[voice] + (_step_div_Q24[voice]>>1)).template to<15>()).template to<15>();
+                }
+                
+                Gain prev_gain_Q10 = _target_gain_Q10[voice];
+                _target_gain_Q10[voice] = AWSynthSource::levelToGain((_volume_Q14[voice]*level_Q10).template to<10>());
+                _delta_gain_Q10[voice] = _target_gain_Q10[voice] - prev_gain_Q10;
+                
+                if(_glide_accu_Q14[voice] > GlideAccu{}) {
+                    _glide_accu_Q14[voice] -= _glide_rate_Q14[voice];
+                    if(_glide_accu_Q14[voice] > GlideAccu{}) {
+                        pitchbend_Q15 += (_glide_interval_Q10[voice]*_glide_accu_Q14[voice]).template to<15>();
+                    }
+                    else {
+                        _glide_accu_Q14[voice] = {};
+                    }
+                }
+                
+                _rate_Q24[voice] = AWSynthSource::rate(_midikey[voice], pitchbend_Q15);
+                
+                // Voice is retired when its release has faded out, like AWSynthSource does at the next span
+                if(_volume_Q14[voice] <= Volume{} && _target_gain_Q10[voice] == Gain{} && _delta_gain_Q10[voice] == Gain{}) {
+                    _active[voice] = false;
+                }
+            }
+        }
+        
+        // Shared control clock
+        std::int32_t _cv_accu_Q20 = AWSynthSource::_ONE_Q20;
+        std::uint64_t _clock = 0;
+        
+        // Voice state, one array per field
+        std::uint32_t _t[Voices] = {};
+        std::uint32_t _p[Voices] = {};
+        std::uint32_t _rate_Q24[Voices] = {};
+        std::uint32_t _phase_Q24[Voices] = {};
+        
+        std::int32_t _step_rate_Q24[Voices] = {};
+        std::int32_t _step_accu_Q24[Voices] = {};
+        std::int32_t _step_div_Q24[Voices] = {};
+        
+        const std::int8_t* _levels[Voices] = {};
+        std::uint8_t _levels_idx[Voices] = {};
+        std::uint8_t _levels_loop[Voices] = {};
+        std::uint8_t _levels_end[Voices] = {};
+        Level _base_level_Q10[Voices] = {};
+        Level _delta_level_Q10[Voices] = {};
+        
+        const std::int8_t* _semitones[Voices] = {};
+        std::uint8_t _semitones_idx[Voices] = {};
+        std::uint8_t _semitones_loop[Voices] = {};
+        std::uint8_t _semitones_end[Voices] = {};
+        Pitch _base_pitchbend_Q10[Voices] = {};
+        Pitch _delta_pitchbend_Q10[Voices] = {};
+        
+        Gain _target_gain_Q10[Voices] = {};
+        Gain _delta_gain_Q10[Voices] = {};
+        
+        Volume _release_rate_Q14[Voices] = {};
+        Volume _volume_Q14[Voices] = {};
+        
+        Glide _glide_interval_Q10[Voices] = {};
+        GlideAccu _glide_rate_Q14[Voices] = {};
+        GlideAccu _glide_accu_Q14[Voices] = {};
+        
+        std::uint8_t _midikey[Voices] = {};
+        bool _released[Voices] = {};
+        bool _active[Voices] = {};
+        
+        Callback _callbacks[Voices] = {};
+        void* _data[Voices] = {};
+};
+
+} // namespace Audio
@@ -101,6 +101,59 @@
 #define PROJ_ENABLE_SYNTH 0
 
 
+// Enable the AWSynth effects bus (feedback delay and low-pass
+// filter shared by all voices). Uses 1 kB of RAM for the send
+// buffer, and the delay line is placed in high RAM if enabled.
+// Optional. Uncomment to enable.
+// #define PROJ_AWSYNTH_EFFECTS
+
+
+// Size of the per-voice state slot of AWSynth voices in bytes.
+// Patches created with AWPatch::withState() and FM voices keep
+// their state there. Every voice reserves this much RAM.
+// Optional. Default is 48.
+// #define PROJ_AWSYNTH_VOICE_STATE_SIZE 48
+
+
+// Size of the delay line pool shared by plucked string voices
+// (AWPatch::pluck()) in bytes. A note takes up to 256 bytes,
+// fewer for higher notes. The pool only takes RAM if a plucked
+// patch is used.
+// Optional. Default is 512.
+// #define PROJ_AWSYNTH_PLUCK_POOL_SIZE 512
+
+
+// Makes AWSynth voices select channel and latency at runtime,
+// so that all channels share one copy of the render loop
+// instead of one per channel. Saves flash at the cost of a few
+// branches per buffer. scripts/AWSynthSizeReport.sh compares
+// the per-symbol sizes of two builds.
+// Optional. Uncomment to enable.
+// #define PROJ_AWSYNTH_COMPACT
+
+
+// Logs timestamped AWSynth voice events (play, first sound,
+// release, stop, buffer fills) into a ring buffer of
+// PROJ_AWSYNTH_TRACE_SIZE entries. Print it with
+// Audio::AWTrace::dump() and decode it with
+// scripts/AWTraceDecode.py to get note-on latencies per channel.
+// No code is generated when disabled. PROJ_AWSYNTH_TRACE_UPDATES
+// also logs every control value update, which fills the ring
+// buffer quickly.
+// Optional. Uncomment to enable. Default size is 256 entries,
+// 8 bytes each.
+// #define PROJ_AWSYNTH_TRACE
+// #define PROJ_AWSYNTH_TRACE_SIZE 256
+// #define PROJ_AWSYNTH_TRACE_UPDATES
+
+
+// Lets AWSynth voices switch to a new version of their patch
+// while playing. Needed by AWPatchWatcher.h, which reloads
+// .awpatch files in the desktop build whenever they are saved.
+// Optional. Uncomment to enable.
+// #define PROJ_AWSYNTH_HOTSWAP
+
+
 // ---- SECTION: TASMODE ----
 // These settings only apply to TASMODE
 
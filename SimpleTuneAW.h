@@ -6,9 +6,9 @@
 
 #define SIMPLE_TUNE_AW(x...)                                            \
     []{                                                                 \
-        struct  constexpr_string_type { const char * chars = #x; };     \
-        using result = Audio::internal::apply_range<sizeof(#x)-1, Audio::internal::count_elements<constexpr_string_type>::produce >::result; \
-        return Audio::internal::genSimpleTuneAW<std::array<Audio::u8, (result::value+1)*2 >>( constexpr_string_type{}.chars ); \
+        constexpr const char* chars = #x;                               \
+        constexpr Audio::u32 count = Audio::internal::countSimpleTuneAW(chars); \
+        return Audio::internal::genSimpleTuneAW<std::array<Audio::u8, (count+1)*2 >>( chars ); \
     }()
 
 
@@ -16,9 +16,9 @@ namespace Audio {
 
 template<u32 channel, u32 timerId>
 class SimpleTuneAW {
-
-    public:
     
+    public:
+        
         constexpr void patch(const AWPatch& patch) { _patch = &patch; }
         
         constexpr void tempo(u32 tempo){ _tempo = 4 * 60000 / tempo; }
@@ -33,9 +33,77 @@ class SimpleTuneAW {
             this->position = 0;
             Schedule::after<timerId>(0, &SimpleTuneAW::play, *this);
         }
+        
+        // Jumps to 'ms' milliseconds from the start of the tune. The note playing at that time is started and its voice
+        // is advanced to where it would be, so the tune continues as if it had been playing all along. With a gliding
+        // patch, the notes played legato before it are started and advanced as well, so that it glides the same way.
+        void seek(u32 ms) {
+            u32 time = 0;
+            u32 first = 0;
+            u32 first_time = 0;
+            bool started = false;
+            bool released = false;
+            bool glide = _patch && _patch->glide() > 0;
+            
+            // Find the last note that started at or before 'ms', or the first of the notes played legato up to it
+            position = 0;
+            while(position < length && time <= ms) {
+                auto note_number = data[position] & 0x7F;
+                if(note_number <= 88) {
+                    if(!started || released || !glide) {
+                        first = position;
+                        first_time = time;
+                    }
+                    started = true;
+                    released = false;
+                }
+                else if(started) {
+                    released = true;
+                }
+                
+                time += duration(data[position+1]);
+                position += 2;
+            }
+            
+            if(_patch && started) {
+                // Events are replayed from the first note on, advancing the voice from one to the next
+                u32 voice_time = first_time;
+                for(u32 pos = first, event_time = first_time; pos < position; event_time += duration(data[pos+1]), pos += 2) {
+                    if(pos != first) {
+                        _source->seek(samples(event_time) - samples(voice_time));
+                        voice_time = event_time;
+                    }
+                    
+                    auto note_number = data[pos] & 0x7F;
+                    if(note_number <= 88) {
+                        _source = &AWSynthSource::play<channel, false>(*_patch, 23+note_number);
+                    }
+                    else {
+                        _source->release();
+                    }
+                }
+                _source->seek(samples(ms) - samples(voice_time));
+            }
+            
+            Schedule::after<timerId>(time > ms ? time - ms : 0, &SimpleTuneAW::play, *this);
+        }
     
     private:
-    
+        
+        // Sample count at 'ms' milliseconds. The product overflows 32 bits after about 9 minutes at 8 kHz.
+        static u32 samples(u32 ms) { return static_cast<std::uint64_t>(ms) * POK_AUD_FREQ / 1000; }
+        
+        u32 duration(signed char noteDuration) const {
+            u32 duration = _tempo;
+            
+            if(noteDuration < 0)
+                duration /= -noteDuration;
+            else if(noteDuration > 0)
+                duration *= noteDuration;
+            
+            return duration;
+        }
+        
         void play() {
             if(position >= length) {
                 if(_source) {
@@ -48,13 +116,7 @@ class SimpleTuneAW {
             
             note_number &= 0x7F;
             
-            signed char noteDuration = data[position++];
-            u32 duration = _tempo;
-            
-            if(noteDuration < 0)
-                duration /= -noteDuration;
-            else if(noteDuration > 0)
-                duration *= noteDuration;
+            u32 duration = this->duration(data[position++]);
             
             if(note_number <= 88){
                 if(_patch) {
@@ -78,7 +140,16 @@ class SimpleTuneAW {
 };
 
 namespace internal {
-
+    
+    // Counts the separators in the tune string. A plain loop keeps compile time linear in the length of the tune.
+    constexpr u32 countSimpleTuneAW(const char *str){
+        u32 count = 0;
+        for(u32 i=0; str[i]; ++i){
+            if(str[i] == ',') count++;
+        }
+        return count;
+    }
+    
     template<typename Array>
     constexpr auto genSimpleTuneAW(const char *str){
         constexpr const u8 noteIndex[] = {
@@ -103,23 +174,30 @@ namespace internal {
             constexpr u32 tempo() const { return _tempo; }
         } array = {};
         
-        for(u32 i=0; str[i];){
+        // Whitespace is skipped in place. Calling a helper with 'str+i' makes the compiler hash the whole string on
+        // every call, which made long tunes compile in quadratic time.
+        u32 i = 0;
+        auto skipWhitespace = [&]{
+            while(str[i] == ' ' || str[i] == '\t' || str[i] == '\r' || str[i] == '\n') i++;
+        };
+        
+        for(; str[i];){
             u32 octave = 4;
             u32 note = 0;
             s8 duration = 0;
             
-            i += countWhitespace(str+i);
+            skipWhitespace();
             if(str[i] >= 'A' && str[i] <= 'G'){
                 note = noteIndex[ str[i++] - 'A' ];
                 
-                i += countWhitespace(str+i);
+                skipWhitespace();
                 if(str[i] == '#'){
                     note++;
                     i++;
                 } else if(str[i] == '-')
                     i++;
                 
-                i += countWhitespace(str+i);
+                skipWhitespace();
                 if(str[i] >= '0' && str[i] <= '9')
                     octave = str[i++] - '0';
                 note = (note + octave * 12) - 14;
@@ -128,16 +206,16 @@ namespace internal {
                 i++;
             }
             
-            i += countWhitespace(str+i);
+            skipWhitespace();
             if(str[i] == '/'){
                 i++;
-                i += countWhitespace(str+i);
+                skipWhitespace();
                 while(str[i] >= '0' && str[i] <= '9')
                     duration = (duration * 10) + str[i++] - '0';
                 duration = -duration;
             } else if( str[i] == '*' ){
                 i++;
-                i += countWhitespace(str+i);
+                skipWhitespace();
                 while(str[i] >= '0' && str[i] <= '9')
                     duration = (duration * 10) + str[i++] - '0';
             }
@@ -145,7 +223,7 @@ namespace internal {
             array[pos++] = note;
             array[pos++] = duration;
             
-            i += countWhitespace(str+i);
+            skipWhitespace();
             if(str[i] == ',') i++;
         }
         return array;
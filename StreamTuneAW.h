@@ -0,0 +1,205 @@
+#pragma once
+
+#include <LibSchedule>
+#include <LibAudio>
+#include "AWSynthSource.h"
+
+#ifdef POKITTO
+#include <File>
+#else
+#include <cstdio>
+#endif
+
+namespace Audio {
+
+namespace internal {
+    
+    // Read-only tune file. Uses the SD card on hardware and a plain file on desktop builds.
+#ifdef POKITTO
+    class TuneFile {
+        public:
+            bool open(const char* path) { return static_cast<bool>(_file.openRO(path)); }
+            u32 read(u8* buffer, u32 count) { return _file.read(buffer, count); }
+            void close() { _file.close(); }
+        
+        private:
+            File _file;
+    };
+#else
+    class TuneFile {
+        public:
+            bool open(const char* path) { close(); _file = std::fopen(path, "rb"); return _file != nullptr; }
+            u32 read(u8* buffer, u32 count) { return _file ? std::fread(buffer, 1, count, _file) : 0; }
+            void close() { if(_file) std::fclose(_file); _file = nullptr; }
+        
+        private:
+            std::FILE* _file = nullptr;
+    };
+#endif
+
+}
+
+// Plays a tune that is streamed from a file instead of being stored in flash. The file contains the same note and
+// duration byte pairs as the arrays created with SIMPLE_TUNE_AW. Notes are read in small chunks into two buffers:
+// one is being played while the other is refilled by prefetch(), which must be called outside the audio interrupt,
+// e.g. once per frame in the main loop. RAM use is fixed no matter how long the tune is.
+template<u32 channel, u32 timerId>
+class StreamTuneAW {
+    
+    public:
+        
+        // Size of one chunk buffer in bytes. Must be even, as each note takes two bytes.
+        static constexpr u32 CHUNK_SIZE = 64;
+        
+        constexpr void patch(const AWPatch& patch) { _patch = &patch; }
+        
+        constexpr void tempo(u32 tempo){ _tempo = 4 * 60000 / tempo; }
+        
+        bool setup(u32 tempo, const AWPatch& patch, const char* path) {
+            stop();
+            
+            _patch = &patch;
+            _source = nullptr;
+            _tempo = 4 * 60000 / tempo;
+            
+            if(!_file.open(path)) {
+                return false;
+            }
+            
+            // Fill both buffers before starting, later chunks are read by prefetch()
+            _eof = false;
+            _current = 0;
+            _position = 0;
+            _ready[0] = false;
+            _ready[1] = false;
+            refill(0);
+            refill(1);
+            
+            _playing = true;
+            Schedule::after<timerId>(0, &StreamTuneAW::play, *this);
+            return true;
+        }
+        
+        // Reads the next chunk into the buffer that has been played. Call regularly from the main loop.
+        void prefetch() {
+            if(!_playing || _eof) {
+                return;
+            }
+            
+            u8 idx = _current ^ 1;
+            if(!_ready[idx]) {
+                refill(idx);
+            }
+        }
+        
+        void stop() {
+            if(_playing && _source) {
+                _source->release();
+            }
+            _playing = false;
+            _file.close();
+        }
+        
+        // Number of times the player had to wait for prefetch()
+        u32 underruns() const { return _underruns; }
+    
+    private:
+        
+        void refill(u8 idx) {
+            u32 count = _file.read(_chunks[idx], CHUNK_SIZE) & ~1U;
+            _length[idx] = count;
+            if(count < CHUNK_SIZE) {
+                _eof = true;
+                _file.close();
+            }
+            _ready[idx] = true;
+        }
+        
+        void play() {
+            if(!_playing) {
+                return;
+            }
+            
+            if(_position >= _length[_current]) {
+                if(_length[_current] < CHUNK_SIZE) {
+                    // Last chunk has been played
+                    stop();
+                    return;
+                }
+                
+                u8 next = _current ^ 1;
+                if(!_ready[next]) {
+                    // Next chunk hasn't been read yet. Try again shortly.
+                    ++_underruns;
+                    Schedule::after<timerId>(1, &StreamTuneAW::play, *this);
+                    return;
+                }
+                
+                // Hand the played buffer over to prefetch() and continue from the other one
+                _ready[_current] = false;
+                _current = next;
+                _position = 0;
+                
+                if(_length[_current] == 0) {
+                    // Tune ended exactly at the end of the last chunk
+                    stop();
+                    return;
+                }
+            }
+            
+            const u8* data = _chunks[_current];
+            
+            auto note_number = data[_position++];
+            
+            note_number &= 0x7F;
+            
+            signed char noteDuration = data[_position++];
+            u32 duration = _tempo;
+            
+            if(noteDuration < 0)
+                duration /= -noteDuration;
+            else if(noteDuration > 0)
+                duration *= noteDuration;
+            
+            if(note_number <= 88){
+                if(_patch) {
+                    _source = &AWSynthSource::play<channel, false>(*_patch, 23+note_number);
+                }
+            }
+            else if(_source) {
+                _source->release();
+            }
+            
+            Schedule::after<timerId>(duration, &StreamTuneAW::play, *this);
+        }
+        
+        const AWPatch* _patch = nullptr;
+        AWSynthSource* _source = nullptr;
+        
+        internal::TuneFile _file;
+        
+        u8 _chunks[2][CHUNK_SIZE];
+        u32 _length[2] = {};
+        volatile bool _ready[2] = {};
+        volatile u8 _current = 0;
+        u32 _position = 0;
+        bool _eof = true;
+        bool _playing = false;
+        
+        u32 _tempo = 4 * 60000 / 120;
+        u32 _underruns = 0;
+};
+
+namespace internal {
+    template <u32 channel, u32 timerId>
+    inline StreamTuneAW<channel, timerId> streamTuneAW;
+}
+
+template<u32 channel=0, u32 timerId=~0U - channel>
+auto& playStreamTuneAW(const char* path, const AWPatch& patch, u32 tempo=120){
+    auto& source = internal::streamTuneAW<channel, timerId>;
+    source.setup(tempo, patch, path);
+    return source;
+}
+
+}  // namespace Audio
@@ -3,6 +3,8 @@
 #include <Pokitto.h>
 #include "AWSynthSource.h"
 #include "SimpleTuneAW.h"
+#include "AWBytebeat.h"
+#include "AWFMSynth.h"
 
 struct RingMod {
     // Callback member function demonstrating ring modulation, pitch slide and vibrato
@@ -28,45 +30,15 @@ struct RingMod {
     std::int32_t modLevel() const { return _modlvl; }
 };
 
-// Converts level (0...100 %) to gain (Q10 fixed point). You can use the exact same operator output levels
-// as in the FM Synth program.
-constexpr std::int32_t fmGain(std::int32_t level) {
-    constexpr const std::int32_t PERCENT_Q15 = 0.01 * (1<<15);
-    std::int32_t lvl_Q15 = level * PERCENT_Q15;
-    std::int32_t gain_Q10 = 9 * ((lvl_Q15*lvl_Q15) >> (1+5+15));
-    return gain_Q10;
-}
-
-// Three operator frequency modulation with feedback
-std::int32_t FreqModCallback(std::uint32_t t, std::uint32_t p) {
-    static std::int32_t fb = 0;                                 // Static variable to store feeback
-    
-    using AWSynth = Audio::AWSynthSource;
-    
-    // Operator 3
-    constexpr const std::int32_t R3 = 1;                        // Pitch ratio 1
-    constexpr const std::int32_t A3_Q10 = fmGain(25);           // Output level 25%
-    std::int32_t o3 = AWSynth::sin(p*R3)*A3_Q10/(1<<10);        // Generate osc 3 output
-    
-    // Operator 2
-    constexpr const std::int32_t R2 = 3;                        // Pitch ratio 3
-    constexpr const std::int32_t A2_Q10 = fmGain(45);           // Output level 45%
-    std::int32_t o2 = AWSynth::sin(p*R2 + fb)*A2_Q10/(1<<10);   // Use feedback to modulate osc 2
-    std::int32_t env2 = AWSynth::ramp<1600>(1600-t);            // Decay envelope for osc 2
-    o2 = o2 * ((env2*env2)>>14) / (1<<14);                      // Squared envelope gives nicer result
-    
-    // Operator 1
-    constexpr const std::int32_t R1 = 1;                        // Pitch ratio 1
-    std::int32_t o1 = AWSynth::sin(p*R1 + o2+o3);               // Use osc 2 and osc 3 to modulate osc 1
-    
-    // Feedback
-    constexpr const std::int32_t AFB_Q10 = fmGain(25);          // Feedback level 25 %
-    fb = o1*AFB_Q10/(1<<10);                                    // Store output of osc 1 to feedback
-    
-    return o1;
-}
+// Three operator frequency modulation with feedback. Operators 2 and 3 modulate operator 1, and the output of
+// operator 1 is fed back to operator 2. You can use the exact same operator output levels as in the FM Synth program.
+static constexpr Audio::AWFMOperator FM_OPERATORS[] = {
+    Audio::AWFMOperator(1, 100),            // Operator 1: pitch ratio 1, output level 100%
+    Audio::AWFMOperator(3, 45, 0, 208, 0),  // Operator 2: pitch ratio 3, output level 45%, decays to zero in 208 ms
+    Audio::AWFMOperator(1, 25)              // Operator 3: pitch ratio 1, output level 25%
+};
 
-constexpr char* EXAMPLE_CASES[] = {"ARCADE", "SYNTHESIS", "BYTEBEAT"};
+constexpr char* EXAMPLE_CASES[] = {"ARCADE", "SYNTHESIS", "BYTEBEAT", "COMPILED BYTEBEAT"};
 
 int main() {
     using Pokitto::Core;
@@ -102,7 +74,7 @@ int main() {
         .semitones(AWPatch::Envelope(   0,  7,  8,  1,  8,  9, 2, 9,10, 3,10,11).smooth(false).loop(11,12));
     
     RingMod ringmod = RingMod();                                    // Create an instance of RingMod class
-    auto* ringmod_cb = AWPatch::makeCallback(&RingMod::callback);   // Turn member function into a regular function pointer
+    auto* ringmod_cb = AWPatch::makeCallback<&RingMod::callback>(); // Turn member function into a regular function pointer
     
     auto ringmod_patch = AWPatch(ringmod_cb, ringmod)               // Pass the callback pointer, and an instance of the class as user data
         .volume(80).step(4).glide(10).release(20)
@@ -110,7 +82,8 @@ int main() {
     
     constexpr auto ringmod_tune = SIMPLE_TUNE_AW(A-4,X, C-5,X, C#5,D#5*4,X, D-5,X, C-5,X, C-5,D-5*3,X, C-5,X, G-4,A-4*7, A-2).tempo(120*16);
     
-    auto fm_patch = AWPatch(FreqModCallback)                        // Regular function callback
+    auto fm_patch = Audio::AWFM::patch<Audio::AWFM::Branch3, FM_OPERATORS>()  // Built-in FM voice, each channel has its own operator state
+        .feedback(25)                                               // Feedback level 25%
         .volume(80).step(4).release(6)
         .amplitudes(AWPatch::Envelope(29,24,15,24,29,31,31,30,29,27,26,24,23,21,20,18).smooth(true))
         .semitones(AWPatch::Envelope(24,20,16,12, 8, 4, 0,-3,-6,-9,-12,-18,-16,-18,-22,-24).smooth(true));
@@ -141,6 +114,15 @@ int main() {
         .volume(80).step(4).release(25)
         .amplitudes(AWPatch::Envelope(0,100).loop(1,2));
     
+    // Same equation compiled at runtime from a string. Slower than the lambda, but it can be changed while the program
+    // runs, as long as no voice is playing the patch during compile().
+    Audio::AWBytebeat compiled_beat;
+    compiled_beat.compile("t*((t>>9|t>>13)&25&t>>6)");
+    
+    auto compiled_patch = AWPatch(Audio::AWBytebeat::callback, compiled_beat)   // Result is truncated to 8 bits and converted to signed value
+        .volume(80).step(4).release(25)
+        .amplitudes(AWPatch::Envelope(0,100).loop(1,2));
+    
     AWSynth* snd1 = nullptr;
     AWSynth* snd2 = nullptr;
     AWSynth* snd3 = nullptr;
@@ -215,13 +197,30 @@ int main() {
                     parambeat_p1 = P1_VALUES[parambeat_idx];
                 }
                 break;
+            
+            case 3:     // Native and runtime compiled bytebeat side by side
+                if(Buttons::pressed(BTN_A)) {
+                    snd1 = &AWSynth::play<0>(bytebeat_patch);
+                }
+                else if(Buttons::released(BTN_A)) {
+                    if(snd1) snd1->release();
+                    snd1 = nullptr;
+                }
+                if(Buttons::pressed(BTN_B)) {
+                    snd2 = &AWSynth::play<1>(compiled_patch);
+                }
+                else if(Buttons::released(BTN_B)) {
+                    if(snd2) snd2->release();
+                    snd2 = nullptr;
+                }
+                break;
         }
         
         if(Buttons::pressed(BTN_RIGHT)) {
-            state = state<2 ? state+1 : 0;      // Switch to previous example
+            state = state<3 ? state+1 : 0;      // Switch to previous example
         }
         if(Buttons::pressed(BTN_LEFT)) {
-            state = state>0 ? state-1 : 2;      // Switch to next example
+            state = state>0 ? state-1 : 3;      // Switch to next example
         }
         
         Display::clear();
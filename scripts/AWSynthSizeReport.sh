@@ -0,0 +1,40 @@
+#!/bin/sh
+# Compares the flash footprint of AWSynth code in two builds, e.g. one built normally and one with
+# PROJ_AWSYNTH_COMPACT defined in My_settings.h:
+#     scripts/AWSynthSizeReport.sh normal.elf compact.elf
+# Prints the size of every Audio:: code symbol in both builds and the totals. Set NM to use another nm.
+
+NM=${NM:-arm-none-eabi-nm}
+FILTER=${FILTER:-Audio::}
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <normal.elf> <compact.elf>" >&2
+    exit 1
+fi
+
+symbols() {
+    # Text symbols only, printed as "size<TAB>name"
+    "$NM" -C -S --size-sort --radix=d "$1" | awk -v filter="$FILTER" '
+        $3 ~ /^[tTwW]$/ {
+            name = $4; for(i = 5; i <= NF; ++i) name = name " " $i;
+            if(index(name, filter) > 0) printf "%d\t%s\n", $2, name;
+        }'
+}
+
+symbols "$1" > /tmp/awsynth_size_a.$$ || exit 1
+symbols "$2" > /tmp/awsynth_size_b.$$ || exit 1
+
+awk -F '\t' '
+    FNR == NR { a[$2] += $1; names[$2] = 1; next }
+    { b[$2] += $1; names[$2] = 1 }
+    END {
+        printf "%8s %8s  %s\n", "normal", "compact", "symbol";
+        for(name in names) {
+            printf "%8d %8d  %s\n", a[name], b[name], name | "sort -k3";
+            total_a += a[name]; total_b += b[name];
+        }
+        close("sort -k3");
+        printf "%8d %8d  %s\n", total_a, total_b, "TOTAL";
+    }' /tmp/awsynth_size_a.$$ /tmp/awsynth_size_b.$$
+
+rm -f /tmp/awsynth_size_a.$$ /tmp/awsynth_size_b.$$
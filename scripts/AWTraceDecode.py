@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+# Decodes the output of Audio::AWTrace::dump() and prints latency statistics per channel.
+#     python3 scripts/AWTraceDecode.py trace.txt
+# Reads standard input if no file is given. Times are in microseconds.
+#
+# play->sound:   from play() to rendering the first non-silent sample
+# play->audible: from play() until that sample reaches the speaker, based on its distance ahead of the play head
+# fill:          time to render one buffer
+
+import sys
+
+EVENTS = ["PLAY", "INIT", "FIRST_SOUND", "UPDATE", "RELEASE", "STOP", "FILL_START", "FILL_END"]
+NO_POSITION = 0xFFFF
+
+
+def stats(values):
+    if not values:
+        return "-"
+    values = sorted(values)
+    def pick(q):
+        return values[min(len(values) - 1, int(q * len(values)))]
+    return "n=%d min=%d median=%d p95=%d max=%d" % (len(values), values[0], pick(0.5), pick(0.95), values[-1])
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+
+    rate, ring = 8000, 4 * 512
+    channels = {}
+    for line in source:
+        line = line.strip()
+        if not line:
+            continue
+        if line.startswith("#"):
+            fields = dict(f.split("=") for f in line.split() if "=" in f)
+            rate = int(fields.get("rate", rate))
+            ring = int(fields.get("buffers", 4)) * int(fields.get("size", 512))
+            if int(fields.get("lost", 0)) > 0:
+                print("note: %s oldest events were overwritten" % fields["lost"])
+            continue
+
+        time, event, channel, arg = (int(f) for f in line.split())
+        ch = channels.setdefault(channel, {
+            "play": None, "play_head": 0, "fill_start": None,
+            "sound": [], "audible": [], "fill": [], "counts": [0] * len(EVENTS)})
+        ch["counts"][event] += 1
+
+        name = EVENTS[event]
+        if name == "PLAY":
+            ch["play"], ch["play_head"] = time, arg
+        elif name == "FIRST_SOUND" and ch["play"] is not None:
+            ch["sound"].append(time - ch["play"])
+            # The sample is played when the play head reaches it. Add whole rounds of the buffer ring if the play
+            # head passed it before it was rendered. Samples rendered outside the ring have no position.
+            if arg != NO_POSITION:
+                audible = (arg - ch["play_head"]) % ring * 1000000 // rate
+                while audible < time - ch["play"]:
+                    audible += ring * 1000000 // rate
+                ch["audible"].append(audible)
+            ch["play"] = None
+        elif name == "FILL_START":
+            ch["fill_start"] = time
+        elif name == "FILL_END" and ch["fill_start"] is not None:
+            ch["fill"].append(time - ch["fill_start"])
+            ch["fill_start"] = None
+
+    for channel in sorted(channels):
+        ch = channels[channel]
+        print("channel %d" % channel)
+        print("  events:        " + " ".join("%s=%d" % (n, c) for n, c in zip(EVENTS, ch["counts"]) if c))
+        print("  play->sound:   " + stats(ch["sound"]))
+        print("  play->audible: " + stats(ch["audible"]))
+        print("  fill:          " + stats(ch["fill"]))
+
+
+if __name__ == "__main__":
+    main()
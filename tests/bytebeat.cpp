@@ -0,0 +1,92 @@
+// Checks AWBytebeat against the same expressions written as C++, and compares the speed of the compiled example
+// expression of main.cpp with the native lambda.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I. tests/bytebeat.cpp -o bytebeat && ./bytebeat
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include "AWBytebeat.h"
+
+using Audio::AWBytebeat;
+
+__attribute__((noinline)) static std::int32_t native(std::uint32_t t, std::uint32_t p, void*) {
+    std::uint32_t b = t*((t>>9|t>>13)&25&t>>6);
+    return (b&255) - 128;
+}
+
+int main() {
+    struct Case {
+        const char* expr;
+        std::uint32_t (*function)(std::uint32_t t, std::uint32_t p);
+    };
+    const Case CASES[] = {
+        {"t*((t>>9|t>>13)&25&t>>6)", [](std::uint32_t t, std::uint32_t p) -> std::uint32_t { return t*((t>>9|t>>13)&25&t>>6); }},
+        {"(t*5&t>>7)|(t*3&t>>10)", [](std::uint32_t t, std::uint32_t p) -> std::uint32_t { return (t*5&t>>7)|(t*3&t>>10); }},
+        {"(t>>4)+(t>>4)*(t>>4)", [](std::uint32_t t, std::uint32_t p) -> std::uint32_t { return (t>>4)+(t>>4)*(t>>4); }},
+        {"t*(0x10+2*3) - -p % 7 / (t>>3) + (t<100) + !t + ~p ^ (t>=5)==1 != 0", [](std::uint32_t t, std::uint32_t p) -> std::uint32_t {
+            std::uint32_t d = t>>3;
+            std::uint32_t m = (-p)%7;
+            return (t*(0x10+2*3) - (d ? m/d : 0) + (t<100) + !t + ~p) ^ (((t>=5)==1) != 0);
+        }},
+        {"42", [](std::uint32_t t, std::uint32_t p) -> std::uint32_t { return 42; }},
+    };
+    
+    int failures = 0;
+    for(const auto& test : CASES) {
+        AWBytebeat beat;
+        if(!beat.compile(test.expr)) {
+            std::printf("FAIL: '%s' doesn't compile\n", test.expr);
+            ++failures;
+            continue;
+        }
+        std::uint32_t bad = 0;
+        for(std::uint32_t t = 0; t < 200000; ++t) {
+            bad += beat.eval(t, t*3) != test.function(t, t*3);
+        }
+        if(bad > 0) {
+            std::printf("FAIL: '%s' differs at %u of 200000 ticks\n", test.expr, bad);
+            ++failures;
+        }
+    }
+    
+    for(const char* expr : {"", "t+", "(t", "t&&1", "x", "t)"}) {
+        AWBytebeat beat;
+        if(beat.compile(expr)) {
+            std::printf("FAIL: '%s' compiles\n", expr);
+            ++failures;
+        }
+    }
+    
+    // An expression that fails to compile, even in place of one that compiled, gives silence rather than 't'
+    for(const char* expr : {"", "t*5"}) {
+        AWBytebeat beat;
+        beat.compile(expr);
+        beat.compile("1+");
+        for(std::uint32_t t : {0u, 1u, 77u, 1000u, 0xffffffffu}) {
+            if(beat.eval(t, t*3) != 0) {
+                std::printf("FAIL: '1+' after '%s' evaluates to %u at t=%u\n", expr, beat.eval(t, t*3), t);
+                ++failures;
+                break;
+            }
+        }
+    }
+    
+    AWBytebeat beat;
+    beat.compile("t*((t>>9|t>>13)&25&t>>6)");
+    
+    constexpr std::uint32_t N = 50000000;
+    auto measure = [&](std::int32_t (*callback)(std::uint32_t, std::uint32_t, void*)) {
+        volatile std::int32_t sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(std::uint32_t t = 0; t < N; ++t) {
+            sink = sink + callback(t, t, &beat);
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N;
+    };
+    double native_ns = measure(native);
+    double compiled_ns = measure(AWBytebeat::callback);
+    std::printf("native lambda %.2f ns/sample, compiled %.2f ns/sample (%.1fx)\n", native_ns, compiled_ns, compiled_ns/native_ns);
+    
+    std::printf(failures ? "bytebeat: %d failures\n" : "bytebeat: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,201 @@
+// Checks that AWControlAhead plays the same samples as AWSynthSource::play(), whether the frames are computed ahead for
+// every buffer, some of them or right after a new note, with releases and new notes in between, and when the buffers
+// are filled on a thread of their own while the frames are computed. Then checks that a release is never lost when it
+// comes while a buffer is filled.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Dprivate=public -Itests/host -I. tests/control_ahead.cpp -o control_ahead && ./control_ahead
+// FLAGS: -Dprivate=public
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "AWSynthSource.h"
+#include "AWControlAhead.h"
+#include "AWFMSynth.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+
+namespace AWFM = Audio::AWFM;
+
+static constexpr std::uint32_t CHANNEL = 1;
+static constexpr std::uint32_t BUFFERS = 80;
+
+using Ahead = Audio::AWControlAhead<CHANNEL>;
+
+static constexpr Audio::AWFMOperator OPERATORS[] = {
+    Audio::AWFMOperator(1, 100), Audio::AWFMOperator(3, 45, 0, 208, 0), Audio::AWFMOperator(1, 25)
+};
+
+// Makes the callback of 'held' release its voice halfway through the next buffer, and if 2, also compute ahead
+static std::uint32_t interrupt = 0;
+
+static const AWPatch held = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t {
+        static std::uint32_t samples = 0;
+        if(interrupt && ++samples == 256) {
+            Ahead::getInstance().release();
+            if(interrupt == 2) {
+                Ahead::computeAhead();
+            }
+            interrupt = 0;
+            samples = 0;
+        }
+        return AWSynthSource::tri(p);
+    })
+    .volume(80).step(4).release(10)
+    .amplitudes(AWPatch::Envelope(31,31).loop(0,2));
+
+struct State {
+    std::int32_t accu = 0;
+};
+
+static void fill(std::vector<std::uint8_t>& out) {
+    std::uint8_t buffer[512];
+    Audio::host::fill(CHANNEL, buffer);
+    out.insert(out.end(), buffer, buffer + 512);
+}
+
+int main() {
+    int failures = 0;
+    
+    static auto jump = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p)/2 + (t&63); })
+        .volume(80).step(4).release(10)
+        .amplitudes(AWPatch::Envelope(31,31,31,29,28,26,24,22,20,18,16,14,12, 0).loop(32,14))
+        .semitones(AWPatch::Envelope(0,0,2,4,6,8,10,12,14,16,18,20,22,24).smooth(true).loop(13,14));
+    static auto state = AWPatch::withState<State>([](std::uint32_t t, std::uint32_t p, void* data)->std::int32_t {
+            auto& state = *static_cast<State*>(data);
+            state.accu += p&7;
+            return AWSynthSource::saw(p + state.accu);
+        })
+        .volume(90).step(10).release(20)
+        .amplitudes(AWPatch::Envelope(31,31,31,31).loop(0,4));
+    static auto fm = AWFM::patch<AWFM::Branch3, OPERATORS>().feedback(25).volume(80).step(8).release(10);
+    static auto glide = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::saw(p); })
+        .volume(70).step(3).release(8).glide(6).unison(3, 20).divider(2, true)
+        .amplitudes(AWPatch::Envelope(31,28,25,22).loop(2,4));
+    static auto pluck = AWPatch::pluck().volume(90).release(6);
+    const AWPatch* patches[] = {&jump, &state, &fm, &glide, &pluck};
+    
+    // Modes: frames for every buffer, for every other buffer, for four buffers of five and right after the new note,
+    // and never
+    for(std::uint32_t patch = 0; patch < 5; ++patch) {
+        for(std::uint32_t release : {3, 7, 50}) {
+            std::uint32_t replay = release/2 + 1;
+            
+            std::vector<std::uint8_t> ref;
+            Audio::AWPluckState::_seed = 0;
+            AWSynthSource::play<CHANNEL, false>(*patches[patch], 60);
+            for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+                if(idx == release) {
+                    AWSynthSource::getInstance<CHANNEL>().release();
+                }
+                if(idx == replay) {
+                    AWSynthSource::play<CHANNEL, false>(*patches[patch], 64);
+                }
+                fill(ref);
+            }
+            Audio::stop<CHANNEL>();
+            
+            for(std::uint32_t mode = 0; mode < 4; ++mode) {
+                std::vector<std::uint8_t> got;
+                Audio::AWPluckState::_seed = 0;
+                auto* voice = &Ahead::play<false>(*patches[patch], 60);
+                for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+                    if(mode == 0 || (mode == 1 && idx%2 == 0) || (mode == 2 && idx%5 != 0)) {
+                        Ahead::computeAhead();
+                    }
+                    if(idx == release) {
+                        voice->release();
+                    }
+                    if(idx == replay) {
+                        voice = &Ahead::play<false>(*patches[patch], 64);
+                        if(mode == 2) {
+                            Ahead::computeAhead();
+                        }
+                    }
+                    fill(got);
+                }
+                Audio::stop<CHANNEL>();
+                
+                std::uint32_t first = 0;
+                while(first < ref.size() && ref[first] == got[first]) {
+                    ++first;
+                }
+                if(first < ref.size()) {
+                    std::printf("FAIL: patch %u, release at %u, mode %u differs from buffer %u on\n", patch, release, mode, first/512);
+                    ++failures;
+                }
+            }
+        }
+    }
+    
+    // Buffers filled on a thread of their own, like the desktop build does, while this thread computes frames ahead
+    // until the last buffer is filled
+    for(std::uint32_t patch = 0; patch < 5; ++patch) {
+        std::vector<std::uint8_t> ref;
+        Audio::AWPluckState::_seed = 0;
+        AWSynthSource::play<CHANNEL, false>(*patches[patch], 60);
+        for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+            fill(ref);
+        }
+        Audio::stop<CHANNEL>();
+        
+        std::vector<std::uint8_t> got;
+        std::atomic<bool> done{false};
+        Audio::AWPluckState::_seed = 0;
+        Ahead::play<false>(*patches[patch], 60);
+        std::thread filler([&] {
+            for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+                fill(got);
+                std::this_thread::yield();
+            }
+            done.store(true, std::memory_order_release);
+        });
+        while(!done.load(std::memory_order_acquire)) {
+            Ahead::computeAhead();
+            std::this_thread::yield();
+        }
+        filler.join();
+        Audio::stop<CHANNEL>();
+        
+        if(got != ref) {
+            std::printf("FAIL: patch %u differs when the buffers are filled on another thread\n", patch);
+            ++failures;
+        }
+    }
+    
+    if(Ahead::framedBuffers() == 0 || Ahead::inlineBuffers() == 0) {
+        std::printf("FAIL: %u buffers framed and %u inline\n", Ahead::framedBuffers(), Ahead::inlineBuffers());
+        ++failures;
+    }
+    
+    // Release, with or without computeAhead(), while a buffer is filled, like the main loop does when the fill runs on
+    // a thread of its own in the desktop build. The callback of the patch calls them halfway through the buffer. The
+    // note must then fade out within 30 buffers, whether the buffers before were filled with frames computed ahead or
+    // not.
+    std::uint32_t lost = 0;
+    for(std::uint32_t run = 0; run < 28; ++run) {
+        std::uint32_t start = 1 + run/4;
+        bool ahead = run & 1;
+        Ahead::play<false>(held, 60);
+        for(std::uint32_t idx = 0; idx < start + 30 && Audio::host::function[CHANNEL] != nullptr; ++idx) {
+            if(ahead || idx > start) {
+                Ahead::computeAhead();
+            }
+            interrupt = idx == start ? 1 + run/2%2 : 0;
+            std::vector<std::uint8_t> out;
+            fill(out);
+        }
+        if(Audio::host::function[CHANNEL] != nullptr) {
+            ++lost;
+        }
+        Audio::stop<CHANNEL>();
+    }
+    if(lost > 0) {
+        std::printf("FAIL: release lost in %u of 28 runs\n", lost);
+        ++failures;
+    }
+    
+    std::printf(failures ? "control_ahead: %d failures\n" : "control_ahead: ok\n", failures);
+    return failures != 0;
+}
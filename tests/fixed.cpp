@@ -0,0 +1,99 @@
+// Checks the Fixed type of AWFixed.h at compile time, and that the control value math ported to it matches the integer
+// code it replaced over its whole input ranges.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Dprivate=public -Itests/host -I. tests/fixed.cpp -o fixed && ./fixed
+// FLAGS: -Dprivate=public
+
+#include <cstdio>
+#include <type_traits>
+#include "AWFixed.h"
+#include "AWSynthSource.h"
+
+using Audio::Fixed;
+using Synth = Audio::AWSynthSource;
+
+// Layout is the plain integer
+static_assert(std::is_trivially_copyable<Fixed<12,10>>::value);
+static_assert(std::is_trivially_default_constructible<Fixed<12,10>>::value);
+static_assert(sizeof(Fixed<12,10>) == 2 && sizeof(Fixed<17,16,false>) == 4 && sizeof(Fixed<40,32>) == 8);
+
+// Products track their bits and fractional bits
+constexpr auto A = Fixed<12,10>::fromDouble(-0.75);
+constexpr auto B = Fixed<17,16,false>::fromDouble(0.5);
+constexpr auto PRODUCT = A*B;
+static_assert(std::is_same<decltype(PRODUCT), const Fixed<29,26,true>>::value);
+static_assert(PRODUCT.to<10>().raw == -384);
+
+// Shifts round toward minus infinity, round() to nearest
+static_assert(Fixed<12,10>::fromRaw(-3).to<8>().raw == -1);
+static_assert(Fixed<12,10>::fromRaw(-3).round<8>().raw == -1);
+static_assert(Fixed<12,10>::fromRaw(-2).round<9>().raw == -1);
+static_assert(Fixed<16,14>::holds(1.0) && !Fixed<16,14>::holds(2.0));
+
+// Only conversions that keep the whole range are implicit
+constexpr Fixed<14,10> WIDER = Fixed<12,10>::fromRaw(5);
+static_assert(WIDER.raw == 5);
+static_assert(!std::is_convertible<Fixed<14,10>, Fixed<12,10>>::value);
+static_assert(!std::is_convertible<Fixed<12,10>, Fixed<12,10,false>>::value);
+static_assert(std::is_convertible<Fixed<11,10,false>, Fixed<12,10>>::value);
+
+// Integer versions from before the port
+static std::uint32_t oldPow2(std::int32_t exp_Q15) {
+    std::uint32_t semitone_Q15 = 12 * (exp_Q15 & 0x7fff);
+    std::uint32_t semitone = semitone_Q15 >> 15;
+    std::uint32_t a = Synth::_SEMITONES_Q15[semitone];
+    std::uint32_t b = Synth::_SEMITONES_Q15[semitone + 1];
+    std::uint32_t fraction = semitone_Q15 & 0x7fff;
+    std::uint32_t shift = 9 + (exp_Q15 >> 15);
+    return ((a + (((b - a) * fraction) >> 15)) << shift) >> 8;
+}
+
+static std::int32_t oldLevelToGain(std::int32_t level_Q10) {
+    return level_Q10 > 0 ? (oldPow2(-((1024-level_Q10)*static_cast<std::int32_t>(3.32193*35/20 * (1<<15))) >> 10) >> 5) : 0;
+}
+
+static std::uint32_t oldRate(std::int32_t midikey, std::int32_t pitchbend_Q15) {
+    return (static_cast<std::uint64_t>(Synth::_RATE_1HZ_Q32) * 440 * oldPow2((midikey-69)*2731 + pitchbend_Q15)) >> (8+15);
+}
+
+int main() {
+    std::uint32_t failures = 0;
+    auto fail = [&](const char* what, std::int32_t input, std::int64_t got, std::int64_t expected) {
+        if(failures++ < 10) {
+            std::printf("FAIL: %s(%d) is %lld instead of %lld\n", what, input, (long long)got, (long long)expected);
+        }
+    };
+    
+    for(std::int32_t exp = -9*32768; exp < 9*32768; ++exp) {
+        if(Synth::pow2(Synth::Exponent::fromRaw(exp)).raw != oldPow2(exp)) {
+            fail("pow2", exp, Synth::pow2(Synth::Exponent::fromRaw(exp)).raw, oldPow2(exp));
+        }
+    }
+    for(std::int32_t level = 0; level <= 1024; ++level) {
+        if(Synth::levelToGain(Fixed<12,10>::fromRaw(level)).raw != oldLevelToGain(level)) {
+            fail("levelToGain", level, Synth::levelToGain(Fixed<12,10>::fromRaw(level)).raw, oldLevelToGain(level));
+        }
+    }
+    for(std::int32_t key = 0; key < 128; ++key) {
+        for(std::int32_t pitchbend = -100000; pitchbend < 100000; pitchbend += 97) {
+            if(Synth::rate(key, Synth::Exponent::fromRaw(pitchbend)) != oldRate(key, pitchbend)) {
+                fail("rate", key*1000000 + pitchbend, Synth::rate(key, Synth::Exponent::fromRaw(pitchbend)), oldRate(key, pitchbend));
+            }
+        }
+    }
+    for(std::int32_t val = -128; val < 128; ++val) {
+        if(Synth::envelopeLevel(val).raw != (val>>2)*32) {
+            fail("envelopeLevel", val, Synth::envelopeLevel(val).raw, (val>>2)*32);
+        }
+        if(Synth::envelopePitch(val).raw != (((val>>2)*2731)>>5)) {
+            fail("envelopePitch", val, Synth::envelopePitch(val).raw, ((val>>2)*2731)>>5);
+        }
+    }
+    for(std::int32_t percent = 0; percent <= 100; ++percent) {
+        if(Synth::percentToVolume(percent).raw != ((percent*((1<<30)/100))>>16)) {
+            fail("percentToVolume", percent, Synth::percentToVolume(percent).raw, (percent*((1<<30)/100))>>16);
+        }
+    }
+    
+    std::printf(failures ? "fixed: %u failures\n" : "fixed: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,136 @@
+// Renders a fixed scene of plain, FM, bytebeat and glide voices on all channels and checks each buffer against the
+// hashes in tests/golden.txt, so that changes to the output don't go unnoticed.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I. tests/golden.cpp -o golden && ./golden
+//     ./golden --write          # Updates tests/golden.txt after an intended change of the output
+//     ./golden --raw out.raw    # Writes the 8-bit output, see tests/golden_diff.sh
+// Only uses the API that AWSynthSource had before the fixed-point port, so older revisions render the same scene.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "AWSynthSource.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+
+static constexpr std::uint32_t BUFFERS = 400;
+static const char* GOLDEN = "tests/golden.txt";
+
+static std::int32_t fmCallback(std::uint32_t t, std::uint32_t p) {
+    static std::int32_t feedback = 0;
+    std::int32_t o3 = AWSynthSource::sin(p)*279/(1<<10);
+    std::int32_t o2 = AWSynthSource::sin(p*3 + feedback)*927/(1<<10);
+    std::int32_t env2 = AWSynthSource::ramp<1600>(1600-t);
+    o2 = o2 * ((env2*env2)>>14) / (1<<14);
+    std::int32_t o1 = AWSynthSource::sin(p + o2+o3);
+    feedback = o1*279/(1<<10);
+    return o1;
+}
+
+static std::uint32_t beat_p1 = 36;
+
+static std::vector<std::uint8_t> render() {
+    auto jump = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p); })
+        .volume(80).step(4).release(0)
+        .amplitudes(AWPatch::Envelope(31,31,31,29,28,26,24,22,20,18,16,14,12, 0).loop(32,14))
+        .semitones(AWPatch::Envelope(   0,  0,  2, 4, 6, 8,10,12,14,16,18,20,22,24).smooth(true).loop(13,14));
+    auto fm = AWPatch(fmCallback).volume(80).step(4).release(6)
+        .amplitudes(AWPatch::Envelope(29,24,15,24,29,31,31,30,29,27,26,24,23,21,20,18).smooth(true))
+        .semitones(AWPatch::Envelope(24,20,16,12, 8, 4, 0,-3,-6,-9,-12,-18,-16,-18,-22,-24).smooth(true));
+    auto beat = AWPatch([](std::uint32_t t, std::uint32_t p, void* data)->std::int32_t {
+            std::uint32_t& p1 = *reinterpret_cast<std::uint32_t*>(data);
+            std::int32_t o = ((p1*t)>>4)|(t>>5)|t;
+            return (o&255) - 128;
+        }, beat_p1)
+        .volume(80).step(4).release(75).amplitudes(AWPatch::Envelope(0,100).loop(1,2));
+    auto glide = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::tri(p); })
+        .volume(90).step(3).glide(10).release(20)
+        .amplitudes(AWPatch::Envelope(31,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16).loop(16,17));
+    
+    std::vector<std::uint8_t> out;
+    AWSynthSource* held = nullptr;
+    AWSynthSource* glided = nullptr;
+    for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+        switch(idx) {
+            case 0: AWSynthSource::play<1, false>(jump, 61); break;
+            case 3: AWSynthSource::play<2, false>(fm, 60); break;
+            case 5: held = &AWSynthSource::play<3, false>(beat); break;
+            case 40: held->release(); break;
+            case 60: glided = &AWSynthSource::play<0, false>(glide, 50); break;
+            case 62: glided = &AWSynthSource::play<0, false>(glide, 57); break;
+            case 70: glided->release(); break;
+            case 100: AWSynthSource::play<2, false>(fm, 72); break;
+        }
+        
+        std::uint8_t* buffer = Audio::audio_buffer + (idx&3)*512;
+        Audio::host::fill(buffer);
+        out.insert(out.end(), buffer, buffer + 512);
+    }
+    return out;
+}
+
+// FNV-1a hash of one buffer
+static std::uint32_t hash(const std::uint8_t* buffer) {
+    std::uint32_t val = 2166136261u;
+    for(std::uint32_t idx = 0; idx < 512; ++idx) {
+        val = (val ^ buffer[idx]) * 16777619u;
+    }
+    return val;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::uint8_t> out = render();
+    
+    if(argc == 3 && std::strcmp(argv[1], "--raw") == 0) {
+        std::FILE* file = std::fopen(argv[2], "wb");
+        if(!file || std::fwrite(out.data(), 1, out.size(), file) != out.size()) {
+            std::printf("golden: can't write %s\n", argv[2]);
+            return 1;
+        }
+        std::fclose(file);
+        return 0;
+    }
+    
+    if(argc == 2 && std::strcmp(argv[1], "--write") == 0) {
+        std::FILE* file = std::fopen(GOLDEN, "w");
+        if(!file) {
+            std::printf("golden: can't write %s\n", GOLDEN);
+            return 1;
+        }
+        std::fprintf(file, "# FNV-1a hashes of the buffers rendered by tests/golden.cpp\n");
+        for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+            std::fprintf(file, "%08x\n", hash(&out[idx*512]));
+        }
+        std::fclose(file);
+        std::printf("golden: wrote %s\n", GOLDEN);
+        return 0;
+    }
+    
+    std::FILE* file = std::fopen(GOLDEN, "r");
+    if(!file) {
+        std::printf("golden: can't read %s\n", GOLDEN);
+        return 1;
+    }
+    std::uint32_t idx = 0;
+    std::uint32_t failures = 0;
+    char line[64];
+    while(std::fgets(line, sizeof(line), file)) {
+        if(line[0] == '#') {
+            continue;
+        }
+        std::uint32_t expected = std::strtoul(line, nullptr, 16);
+        if(idx < BUFFERS && hash(&out[idx*512]) != expected && failures++ < 5) {
+            std::printf("FAIL: buffer %u differs\n", idx);
+        }
+        ++idx;
+    }
+    std::fclose(file);
+    if(idx != BUFFERS) {
+        std::printf("FAIL: %s has %u buffers instead of %u\n", GOLDEN, idx, BUFFERS);
+        ++failures;
+    }
+    
+    std::printf(failures ? "golden: %u buffers differ\n" : "golden: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Renders the scene of tests/golden.cpp with the headers of two revisions and prints how far the outputs are apart.
+# Use it to check how much a change that updates tests/golden.txt moves the output. Run from the repository root:
+#     tests/golden_diff.sh 352c9f9^ 352c9f9     # Before and after the fixed-point port
+#     tests/golden_diff.sh HEAD                 # HEAD against the working tree
+# The stand-in headers in tests/host and tests/golden.cpp are taken from the working tree. Set CXX to use another
+# compiler.
+
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++17 -O2 -Wno-narrowing"
+WORK=/tmp/awsynth_golden_diff.$$
+
+if [ $# -lt 1 ] || [ $# -gt 2 ]; then
+    echo "Usage: $0 <revision> [<revision>]" >&2
+    exit 1
+fi
+
+# Renders the scene with the headers of revision $1, or of the working tree if it's empty, into $2
+render() {
+    dir=.
+    if [ -n "$1" ]; then
+        dir="$WORK/src"
+        rm -rf "$dir" && mkdir -p "$dir" && git archive "$1" | tar -x -C "$dir" || return 1
+    fi
+    $CXX $FLAGS -Itests/host -I"$dir" tests/golden.cpp -o "$WORK/golden" && "$WORK/golden" --raw "$2"
+}
+
+mkdir -p "$WORK" || exit 1
+status=0
+if render "$1" "$WORK/a.raw" && render "$2" "$WORK/b.raw"; then
+    python3 - "$WORK/a.raw" "$WORK/b.raw" <<'PYTHON'
+import sys
+a = open(sys.argv[1], "rb").read()
+b = open(sys.argv[2], "rb").read()
+diffs = [abs(x - y) for x, y in zip(a, b)]
+changed = sum(1 for d in diffs if d)
+print("samples: %d, changed: %d, max deviation: %d LSB" % (len(diffs), changed, max(diffs) if diffs else 0))
+if diffs:
+    hist = {}
+    for d in diffs:
+        if d:
+            hist[d] = hist.get(d, 0) + 1
+    print("deviations: " + " ".join("%d:%d" % (d, hist[d]) for d in sorted(hist)))
+PYTHON
+else
+    status=1
+fi
+
+rm -rf "$WORK"
+exit $status
@@ -0,0 +1,21 @@
+#pragma once
+
+// Stand-in for Pokitto.h, enough to check that main.cpp compiles on a desktop. The main loop exits at once.
+
+enum { BTN_A, BTN_B, BTN_C, BTN_UP, BTN_DOWN, BTN_LEFT, BTN_RIGHT };
+
+namespace Pokitto {
+    struct Core {
+        static void begin() {}
+        static bool isRunning() { return false; }
+        static bool update() { return true; }
+    };
+    struct Display {
+        static void clear() {}
+        static void print(const char*) {}
+    };
+    struct Buttons {
+        static bool pressed(int) { return false; }
+        static bool released(int) { return false; }
+    };
+}
@@ -0,0 +1,66 @@
+// Runs AWLoadTest with game SFX, key mashing on a bytebeat patch and a tune on every channel, and prints its report.
+// Checks that every buffer was rendered, that the buffer latency stays within the ring of buffers and that steals
+// are counted only for the voices they cut off. Takes the simulated time in seconds, 60 by default.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I. tests/loadtest.cpp -o loadtest && ./loadtest 600
+// On the desktop the render times are much shorter than on the Pokitto. Scale the deadline down, here to 1/48 of the
+// buffer period, to see where the device would run out of time.
+
+#include <cstdio>
+#include <cstdlib>
+#include "AWLoadTest.h"
+#include "SimpleTuneAW.h"
+
+using Audio::AWLoadTest;
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+
+int main(int argc, char** argv) {
+    int failures = 0;
+    std::uint32_t seconds = argc > 1 ? std::atoi(argv[1]) : 60;
+    
+    static auto coin = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p); })
+        .volume(80).step(2).release(4)
+        .amplitudes(AWPatch::Envelope(31,31,28,24,20,16,12,8,4,0).loop(32,10))
+        .semitones(AWPatch::Envelope(0,12,12,12,12,12,12,12,12,12).loop(32,10));
+    static auto beat = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { t = p; return (((t*5&t>>7)|(t*3&t>>10))&255) - 128; })
+        .volume(60).step(1).release(20);
+    static auto arp = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p); })
+        .volume(80).step(6).release(12)
+        .amplitudes(AWPatch::Envelope(31,31,31,31).loop(32,4))
+        .semitones(AWPatch::Envelope(0,12,4,7).loop(0,4));
+    static auto tune = SIMPLE_TUNE_AW(A-3,A-3,G-3,E-4,E-4,D-4,D-4,A-3,A-3).tempo(120*8);
+    tune.patch(arp);
+    
+    constexpr std::uint32_t PERIOD_US = 512 * 1000000ull / POK_AUD_FREQ;
+    constexpr double RING_MS = 512.0 * Audio::bufferCount * 1000 / POK_AUD_FREQ;
+    
+    // Key mashing alone never steals, as a gate is only pressed again after it was released
+    AWLoadTest mash;
+    auto report = mash.keyMash(beat, 30).run(seconds);
+    if(report.triggers == 0 || report.steals != 0) {
+        std::printf("FAIL: key mashing alone steals %u voices in %u triggers\n", report.steals, report.triggers);
+        ++failures;
+    }
+    
+    AWLoadTest test;
+    test.sfx(coin, 4).keyMash(beat, 30).tunes(tune).deadline(PERIOD_US/48);
+    report = test.run(seconds);
+    report.print();
+    
+    std::uint32_t buffers = static_cast<std::uint64_t>(seconds) * POK_AUD_FREQ / 512;
+    if(report.buffers < buffers || report.buffers > buffers + 1) {
+        std::printf("FAIL: %u buffers rendered in %u s, expected %u\n", report.buffers, seconds, buffers);
+        ++failures;
+    }
+    if(report.triggers == 0 || report.steals == 0 || report.steals >= report.triggers) {
+        std::printf("FAIL: %u steals of %u triggers\n", report.steals, report.triggers);
+        ++failures;
+    }
+    if(report.latency_min_ms < 0 || report.latency_max_ms > RING_MS) {
+        std::printf("FAIL: buffer latency %.1f...%.1f ms, ring is %.1f ms\n", report.latency_min_ms, report.latency_max_ms, RING_MS);
+        ++failures;
+    }
+    
+    std::printf(failures ? "loadtest: %d failures\n" : "loadtest: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,173 @@
+// Loads every .awpatch file in sounds/ with AWPatchWatcher and compares the numbers with the JSON, checks that a broken
+// file reports the key that failed, that the keys may come in any order, and that a hot-swapped patch is only reported
+// as playing while a voice sounds it, also when the voice stops before it switches.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -DPROJ_AWSYNTH_HOTSWAP -Dprivate=public -Itests/host -I. tests/patch_watcher.cpp -o patch_watcher && ./patch_watcher
+// FLAGS: -DPROJ_AWSYNTH_HOTSWAP -Dprivate=public
+
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include "AWPatchWatcher.h"
+
+using Audio::AWPatchWatcher;
+using Audio::AWSynthSource;
+
+static std::string readFile(const std::string& path) {
+    std::string text;
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    char buffer[512];
+    for(std::size_t count; file && (count = std::fread(buffer, 1, sizeof(buffer), file)) > 0; ) {
+        text.append(buffer, count);
+    }
+    if(file) {
+        std::fclose(file);
+    }
+    return text;
+}
+
+static void writeFile(const char* path, const std::string& text) {
+    std::FILE* file = std::fopen(path, "wb");
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+}
+
+// Value of a top level number in the JSON text, quoted or not
+static std::int32_t jsonNumber(const std::string& text, const char* key) {
+    std::size_t pos = text.find(std::string("\"") + key + "\"");
+    pos = text.find_first_not_of(" :\"", text.find(':', pos));
+    return std::atoi(text.c_str() + pos);
+}
+
+int main() {
+    int failures = 0;
+    auto check = [&](bool ok, const std::string& what) {
+        if(!ok) {
+            std::printf("FAIL: %s\n", what.c_str());
+            ++failures;
+        }
+    };
+    
+    std::uint32_t files = 0;
+    DIR* dir = opendir("sounds");
+    check(dir != nullptr, "sounds/ exists");
+    for(dirent* entry; dir && (entry = readdir(dir)) != nullptr; ) {
+        std::string name = entry->d_name;
+        if(name.size() < 8 || name.substr(name.size() - 8) != ".awpatch") {
+            continue;
+        }
+        
+        std::string path = "sounds/" + name;
+        AWPatchWatcher watcher(path.c_str());
+        check(watcher.error().empty(), path + " loads, failed at \"" + watcher.error() + "\"");
+        
+        std::string text = readFile(path);
+        const auto& patch = watcher.patch();
+        check(patch.volume() == jsonNumber(text, "volume") && patch.step() == jsonNumber(text, "step") &&
+              patch.release() == jsonNumber(text, "release") && patch.glide() == jsonNumber(text, "glide"),
+              path + " has the numbers of the file");
+        ++files;
+    }
+    if(dir) {
+        closedir(dir);
+    }
+    check(files == 12, "all 12 patches in sounds/ were found");
+    
+    // Broken copies of a patch
+    static const char* PATH = "/tmp/awsynth_patch_watcher.awpatch";
+    std::string coin = readFile("sounds/coin.awpatch");
+    struct Broken {
+        const char* from;
+        const char* to;
+        const char* key;
+    };
+    for(const Broken& broken : {Broken{"\"step\":\"3\"", "\"step\":\"3x\"", "step"},
+                                Broken{"\"release\":\"0\"", "\"release\":\"\"", "release"},
+                                Broken{"\"square\"", "\"squares\"", "waveform"},
+                                Broken{"\"loop_start\":32", "\"loop_start\":x", "semitones.loop_start"}}) {
+        std::string text = coin;
+        std::size_t pos = text.find(broken.from);
+        check(pos != std::string::npos, std::string("coin.awpatch has ") + broken.from);
+        if(pos == std::string::npos) {
+            continue;
+        }
+        writeFile(PATH, text.replace(pos, std::strlen(broken.from), broken.to));
+        
+        AWPatchWatcher watcher(PATH);
+        check(watcher.error() == broken.key, std::string("broken ") + broken.key + " is reported as \"" + watcher.error() + "\"");
+    }
+    
+    // Keys in another order and spacing, with key names in earlier values and in nested objects, load the same patch
+    std::size_t waveform = coin.find("\"waveform\"");
+    std::size_t semitones = coin.find("\"semitones\"");
+    std::size_t amplitudes = coin.find("\"amplitudes\"");
+    std::string reordered = "{" + coin.substr(semitones, amplitudes - semitones) +
+                            coin.substr(amplitudes, coin.rfind('}') - amplitudes) + "," +
+                            coin.substr(waveform, semitones - waveform) +
+                            "\"steps\" : 7, \"glide\" : 0, \"release\" : \"0\", \"step\" : \"3\", \"volume\" : 80}";
+    writeFile(PATH, reordered);
+    AWPatchWatcher original("sounds/coin.awpatch");
+    AWPatchWatcher shuffled(PATH);
+    const auto& a = original.patch();
+    const auto& b = shuffled.patch();
+    check(shuffled.error().empty(), "reordered coin.awpatch loads, failed at \"" + shuffled.error() + "\"");
+    check(a.volume() == b.volume() && a.step() == b.step() && a.release() == b.release() && a.glide() == b.glide() &&
+          std::memcmp(a.amplitudes().data(), b.amplitudes().data(), Audio::AWPatch::Envelope::SIZE) == 0 &&
+          std::memcmp(a.semitones().data(), b.semitones().data(), Audio::AWPatch::Envelope::SIZE) == 0,
+          "reordered coin.awpatch has the values of the original");
+    
+    // A swapped out patch is playing until its voice has faded out
+    writeFile(PATH, coin);
+    AWPatchWatcher watcher(PATH);
+    const auto& first = watcher.patch();
+    auto& voice = AWSynthSource::play<1, false>(first, 60);
+    check(AWSynthSource::isPlaying(first), "patch is playing");
+    
+    // Writes a new version of the file with the volume changed, dated a second after the last so that poll() sees it
+    time_t date = 0;
+    auto rewrite = [&](int volume) {
+        std::string changed = coin;
+        changed.replace(changed.find("\"volume\":80"), 11, "\"volume\":" + std::to_string(volume));
+        writeFile(PATH, changed);
+        struct stat info;
+        stat(PATH, &info);
+        date = (date > info.st_mtim.tv_sec ? date : info.st_mtim.tv_sec) + 1;
+        struct timespec times[2] = {info.st_atim, {date, 0}};
+        utimensat(AT_FDCWD, PATH, times, 0);
+    };
+    rewrite(70);
+    check(watcher.poll(), "new version is loaded");
+    check(&watcher.patch() != &first && watcher.patch().volume() == 70, "new version is in the other slot");
+    check(AWSynthSource::isPlaying(watcher.patch()), "voice is about to switch to the new version");
+    
+    voice.release();
+    std::uint8_t buffer[512];
+    for(std::uint32_t idx = 0; idx < 100 && Audio::host::function[1]; ++idx) {
+        Audio::host::fill(1, buffer);
+    }
+    check(!Audio::host::function[1], "voice has faded out");
+    check(!AWSynthSource::isPlaying(first) && !AWSynthSource::isPlaying(watcher.patch()), "faded out voice isn't playing");
+    
+    // A voice that stops before its next control value update never switches, and mustn't keep the new version
+    // playing, or the watcher couldn't reuse its slot
+    auto& last = AWSynthSource::play<1, false>(watcher.patch(), 60);
+    Audio::host::fill(1, buffer);
+    rewrite(60);
+    check(watcher.poll(), "version after a played note is loaded");
+    last._volume_Q14 = {};
+    last._target_gain_Q10 = {};
+    last._delta_gain_Q10 = {};
+    Audio::host::fill(1, buffer);
+    check(!Audio::host::function[1], "silenced voice has stopped");
+    check(!AWSynthSource::isPlaying(watcher.patch()), "voice stopped before the switch is playing the new version");
+    rewrite(50);
+    check(watcher.poll(), "version after a stopped voice is loaded");
+    rewrite(40);
+    check(watcher.poll() && watcher.patch().volume() == 40, "slot of a version the stopped voice never played is reused");
+    AWSynthSource::play<1, false>(watcher.patch(), 60);
+    check(AWSynthSource::isPlaying(watcher.patch()), "new note doesn't play the latest version");
+    
+    std::printf(failures ? "patch_watcher: %d failures\n" : "patch_watcher: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,122 @@
+// Checks that AWRenderAhead plays the same samples as AWSynthSource::play(), whether blocks are rendered ahead when
+// none, some or all of the audio buffers are free, or never, with releases and new notes in between that drop the
+// blocks rendered ahead.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Dprivate=public -Itests/host -I. tests/render_ahead.cpp -o render_ahead && ./render_ahead
+// FLAGS: -Dprivate=public
+
+#include <cstdio>
+#include <vector>
+#include "AWSynthSource.h"
+#include "AWRenderAhead.h"
+#include "AWFMSynth.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+
+namespace AWFM = Audio::AWFM;
+
+static constexpr std::uint32_t CHANNEL = 1;
+static constexpr std::uint32_t BLOCKS = 3;
+static constexpr std::uint32_t BUFFERS = 80;
+
+using Ahead = Audio::AWRenderAhead<CHANNEL, BLOCKS>;
+
+static constexpr Audio::AWFMOperator OPERATORS[] = {
+    Audio::AWFMOperator(1, 100), Audio::AWFMOperator(3, 45, 0, 208, 0), Audio::AWFMOperator(1, 25)
+};
+
+struct State {
+    std::int32_t accu = 0;
+};
+
+static void fill(std::vector<std::uint8_t>& out) {
+    std::uint8_t buffer[512];
+    Audio::host::fill(CHANNEL, buffer);
+    out.insert(out.end(), buffer, buffer + 512);
+}
+
+// Marks the first 'free' audio buffers as free and the others as filled
+static void setFree(std::uint32_t free) {
+    for(std::uint32_t idx = 0; idx < Audio::bufferCount; ++idx) {
+        Audio::audio_state[idx] = idx >= free;
+    }
+}
+
+int main() {
+    int failures = 0;
+    
+    static auto jump = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p)/2 + (t&63); })
+        .volume(80).step(4).release(10)
+        .amplitudes(AWPatch::Envelope(31,31,31,29,28,26,24,22,20,18,16,14,12, 0).loop(32,14))
+        .semitones(AWPatch::Envelope(0,0,2,4,6,8,10,12,14,16,18,20,22,24).smooth(true).loop(13,14));
+    static auto state = AWPatch::withState<State>([](std::uint32_t t, std::uint32_t p, void* data)->std::int32_t {
+            auto& state = *static_cast<State*>(data);
+            state.accu += p&7;
+            return AWSynthSource::saw(p + state.accu);
+        })
+        .volume(90).step(10).release(20)
+        .amplitudes(AWPatch::Envelope(31,31,31,31).loop(0,4));
+    static auto fm = AWFM::patch<AWFM::Branch3, OPERATORS>().feedback(25).volume(80).step(8).release(10);
+    static auto glide = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::saw(p); })
+        .volume(70).step(3).release(8).glide(6).unison(3, 20).divider(2, true)
+        .amplitudes(AWPatch::Envelope(31,28,25,22).loop(2,4));
+    const AWPatch* patches[] = {&jump, &state, &fm, &glide};
+    
+    // Modes: blocks rendered before every buffer with no audio buffer free, with two free and with all free, and never
+    static constexpr std::uint32_t FREE[] = {0, 2, Audio::bufferCount};
+    for(std::uint32_t patch = 0; patch < 4; ++patch) {
+        for(std::uint32_t release : {3, 7, 50}) {
+            std::uint32_t replay = release/2 + 1;
+            
+            std::vector<std::uint8_t> ref;
+            AWSynthSource::play<CHANNEL, false>(*patches[patch], 60);
+            for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+                if(idx == release) {
+                    AWSynthSource::getInstance<CHANNEL>().release();
+                }
+                if(idx == replay) {
+                    AWSynthSource::play<CHANNEL, false>(*patches[patch], 64);
+                }
+                fill(ref);
+            }
+            Audio::stop<CHANNEL>();
+            
+            for(std::uint32_t mode = 0; mode < 4; ++mode) {
+                std::vector<std::uint8_t> got;
+                auto* voice = &Ahead::play<false>(*patches[patch], 60);
+                for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+                    if(mode < 3) {
+                        setFree(FREE[mode]);
+                        std::uint32_t rendered = Ahead::renderAhead();
+                        std::uint32_t expected = mode == 0 ? 1 : (FREE[mode] < BLOCKS ? FREE[mode] : BLOCKS);
+                        if(idx == 0 && rendered != expected) {
+                            std::printf("FAIL: patch %u, %u buffers free, %u blocks rendered ahead, expected %u\n",
+                                        patch, FREE[mode], rendered, expected);
+                            ++failures;
+                        }
+                    }
+                    if(idx == release) {
+                        voice->release();
+                    }
+                    if(idx == replay) {
+                        voice = &Ahead::play<false>(*patches[patch], 64);
+                    }
+                    fill(got);
+                }
+                Audio::stop<CHANNEL>();
+                
+                std::uint32_t first = 0;
+                while(first < ref.size() && ref[first] == got[first]) {
+                    ++first;
+                }
+                if(first < ref.size()) {
+                    std::printf("FAIL: patch %u, release at %u, mode %u differs from buffer %u on\n", patch, release, mode, first/512);
+                    ++failures;
+                }
+            }
+        }
+    }
+    
+    std::printf(failures ? "render_ahead: %d failures\n" : "render_ahead: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,44 @@
+// Measures the time the buffer fill takes per sample and voice, for two voices with smooth envelopes, pitch slides and
+// glide, so most of the time goes to the control values and gain. Best of 8 runs of 4000 buffers.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I. tests/render_bench.cpp -o render_bench && ./render_bench
+// Only uses the API that AWSynthSource had before the fixed-point port. To compare with an older revision, build it
+// against the headers of that revision:
+//     mkdir /tmp/old && git archive 352c9f9^ | tar -x -C /tmp/old
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I/tmp/old tests/render_bench.cpp -o render_bench_old && ./render_bench_old
+
+#include <chrono>
+#include <cstdio>
+#include "AWSynthSource.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+
+int main() {
+    auto jump = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p); })
+        .volume(80).step(4).release(0)
+        .amplitudes(AWPatch::Envelope(31,31,31,29,28,26,24,22,20,18,16,14,12, 0).loop(2,14).smooth(true))
+        .semitones(AWPatch::Envelope(   0,  0,  2, 4, 6, 8,10,12,14,16,18,20,22,24).smooth(true).loop(2,14));
+    auto glide = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::tri(p); })
+        .volume(90).step(3).glide(10).release(20)
+        .amplitudes(AWPatch::Envelope(31,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16).loop(1,17).smooth(true));
+    
+    constexpr std::uint32_t BUFFERS = 4000;
+    double best = 1e9;
+    std::uint32_t sum = 0;
+    for(std::uint32_t run = 0; run < 8; ++run) {
+        AWSynthSource::play<1, false>(jump, 61);
+        AWSynthSource::play<2, false>(glide, 50);
+        AWSynthSource::play<2, false>(glide, 57);
+        
+        auto start = std::chrono::steady_clock::now();
+        for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+            Audio::host::fill(Audio::audio_buffer);
+            sum += Audio::audio_buffer[idx & 511];
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (BUFFERS*512*2);
+        best = ns < best ? ns : best;
+    }
+    
+    std::printf("render: %.2f ns per sample per voice (checksum %u)\n", best, sum);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Builds and runs the desktop tests and benchmarks in tests/ against the stand-in PokittoLib headers in tests/host.
+# Run from the repository root:
+#     tests/run.sh                    # main.cpp in every build mode and the mode checks, then every test
+#     tests/run.sh seek bytebeat      # Only tests/seek.cpp and tests/bytebeat.cpp
+# A test can ask for extra compiler flags with a "// FLAGS: ..." line. Each test exits with a non-zero status when
+# it fails, and so does this script. Set CXX to use another compiler and OUT for where the programs are built.
+
+CXX=${CXX:-g++}
+OUT=${OUT:-/tmp/awsynth_tests}
+FLAGS="-std=gnu++17 -O2 -Wall -Wno-narrowing -Wno-write-strings -Itests/host -I."
+
+mkdir -p "$OUT" || exit 1
+failed=""
+
+names="$*"
+if [ -z "$names" ]; then
+    for mode in "" -DPROJ_AWSYNTH_COMPACT -DPROJ_AWSYNTH_TRACE -DPROJ_AWSYNTH_HOTSWAP -DPROJ_AWSYNTH_EFFECTS; do
+        echo "== main.cpp $mode"
+        $CXX $FLAGS $mode -fsyntax-only main.cpp || failed="$failed main$mode"
+    done
+    
+    # Plucked strings are only linked into programs that build a plucked patch. Built without optimization, so that
+    # every function that is used has a symbol of its own.
+    echo "== link without pluck"
+    printf '%s\n' '#include "AWSynthSource.h"' \
+        'static const Audio::AWPatch patch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return p; });' \
+        'int main() { Audio::AWSynthSource::play<1>(patch); }' > "$OUT/link.cpp"
+    for mode in "" -DPROJ_AWSYNTH_COMPACT; do
+        if ! $CXX $FLAGS $mode -O0 "$OUT/link.cpp" -o "$OUT/link" || nm -C "$OUT/link" | grep "AWPluckState::render\|AWPluckState::init"; then
+            failed="$failed link$mode"
+        fi
+    done
+    
+    # The load test plays on every channel but the one of the effects bus
+    echo "== loadtest -DPROJ_AWSYNTH_EFFECTS"
+    if ! $CXX $FLAGS -DPROJ_AWSYNTH_EFFECTS tests/loadtest.cpp -o "$OUT/loadtest_effects" || ! "$OUT/loadtest_effects" 10; then
+        failed="$failed loadtest-DPROJ_AWSYNTH_EFFECTS"
+    fi
+    
+    names=$(for file in tests/*.cpp; do basename "$file" .cpp; done)
+fi
+
+for name in $names; do
+    echo "== $name"
+    extra=$(sed -n 's|^// FLAGS: ||p' "tests/$name.cpp")
+    if ! $CXX $FLAGS $extra "tests/$name.cpp" -o "$OUT/$name" -lpthread || ! "$OUT/$name"; then
+        failed="$failed $name"
+    fi
+done
+
+if [ -n "$failed" ]; then
+    echo "FAILED:$failed"
+    exit 1
+fi
+echo "All passed"
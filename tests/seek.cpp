@@ -0,0 +1,207 @@
+// Checks that seeking gives the same output as playing through. AWSynthSource::seek() is checked at sample counts on
+// and off buffer and envelope step boundaries, with and without a release. SimpleTuneAW::seek() is checked at times
+// on note starts, which must match to the end of the tune, and between them, which must match up to the next note.
+// The patches include an FM voice and a gliding one, whose legato notes must glide the same way after a seek, and
+// a seek far into a long note checks that the sample count doesn't overflow.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I. tests/seek.cpp -o seek && ./seek
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "AWSynthSource.h"
+#include "AWFMSynth.h"
+#include "SimpleTuneAW.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+
+static constexpr std::uint32_t CHANNEL = 1;
+static constexpr std::uint32_t TIMER = 7;
+static constexpr std::uint32_t BUFFERS = 200;
+
+static constexpr Audio::AWFMOperator OPERATORS[] = {
+    Audio::AWFMOperator(1, 100, 30, 400, 60), Audio::AWFMOperator(2, 40, 0, 600, 20)
+};
+
+// Renders whole buffers of the channel from its current position
+static void render(std::vector<std::uint8_t>& out, std::uint32_t buffers) {
+    for(std::uint32_t idx = 0; idx < buffers; ++idx) {
+        std::uint8_t buffer[512];
+        Audio::host::fill(CHANNEL, buffer);
+        out.insert(out.end(), buffer, buffer + 512);
+    }
+}
+
+// Releases the voice of the channel, so that the next note doesn't glide from the last one
+static void stop() {
+    AWSynthSource::getInstance<CHANNEL>().release();
+    Audio::stop<CHANNEL>();
+}
+
+// Returns the number of samples from 'offset' on where 'got' and 'ref' differ
+static std::uint32_t compare(const std::vector<std::uint8_t>& ref, std::uint32_t offset, const std::vector<std::uint8_t>& got,
+                             std::uint32_t length) {
+    std::uint32_t diffs = 0;
+    for(std::uint32_t idx = 0; idx < length && idx < got.size() && offset + idx < ref.size(); ++idx) {
+        diffs += got[idx] != ref[offset + idx];
+    }
+    return diffs;
+}
+
+// Plays 'patch', releases it after 'release' samples unless that is negative, and compares seeking to 'position'
+// with rendering from the start
+static std::uint32_t checkVoice(const AWPatch& patch, std::uint8_t key, std::uint32_t position, std::int32_t release) {
+    // Voices are released between buffers, so a release inside a buffer is seeked to in the reference as well
+    std::uint32_t start = release >= 0 && release % 512 ? release : 0;
+    if(release >= 0 && static_cast<std::uint32_t>(release) > position) {
+        return 0;
+    }
+    
+    std::vector<std::uint8_t> ref;
+    stop();
+    auto& voice = AWSynthSource::play<CHANNEL, false>(patch, key);
+    if(start > 0) {
+        voice.seek(start);
+        voice.release();
+    }
+    for(std::uint32_t pos = start; pos < 512*BUFFERS; pos += 512) {
+        if(release >= 0 && pos == static_cast<std::uint32_t>(release)) {
+            voice.release();
+        }
+        render(ref, 1);
+    }
+    
+    std::vector<std::uint8_t> got;
+    stop();
+    auto& seeked = AWSynthSource::play<CHANNEL, false>(patch, key);
+    if(release >= 0) {
+        seeked.seek(release);
+        seeked.release();
+        seeked.seek(position - release);
+    }
+    else {
+        seeked.seek(position);
+    }
+    render(got, BUFFERS - position/512 - 1);
+    return compare(ref, position - start, got, got.size());
+}
+
+// Runs the tune from 'begin' samples, firing the scheduled notes at the start of the buffer they fall in
+static void playTune(std::vector<std::uint8_t>& out, std::uint32_t begin, std::uint32_t end) {
+    std::uint32_t next = begin + Schedule::host::Timer<TIMER>::delay * POK_AUD_FREQ / 1000;
+    for(std::uint32_t pos = begin; pos < end; pos += 512) {
+        while(Schedule::host::Timer<TIMER>::call && next <= pos) {
+            Schedule::host::run<TIMER>();
+            next += Schedule::host::Timer<TIMER>::delay * POK_AUD_FREQ / 1000;
+        }
+        render(out, 1);
+    }
+}
+
+int main() {
+    auto jump = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p)/2 + (int)(t&63); })
+        .volume(80).step(4).release(10)
+        .amplitudes(AWPatch::Envelope(31,31,31,29,28,26,24,22,20,18,16,14,12, 0).loop(32,14))
+        .semitones(AWPatch::Envelope(   0,  0,  2, 4, 6, 8,10,12,14,16,18,20,22,24).smooth(true).loop(13,14));
+    auto pad = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::saw(p); })
+        .unison(3,20).volume(90).step(30).release(40)
+        .amplitudes(AWPatch::Envelope(20,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16).loop(10,17))
+        .semitones(AWPatch::Envelope(0,0,12,12,0,0,7,7).loop(0,8));
+    auto slide = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::saw(p); })
+        .unison(4,35).volume(90).step(10).release(5)
+        .amplitudes(AWPatch::Envelope(31,31,31,31,28,28,26).effects(0,1,2,3,0,2,3).loop(2,6))
+        .semitones(AWPatch::Envelope(0,5,-5,3,0,-12,12).effects(3,1,2,3,0,1,2).loop(1,7));
+    auto glide = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::tri(p); })
+        .volume(80).step(6).glide(8).release(12)
+        .amplitudes(AWPatch::Envelope(31,30,29,28).loop(1,4))
+        .semitones(AWPatch::Envelope(0,0,1,0).loop(0,4));
+    auto fm = Audio::AWFM::patch<Audio::AWFM::Serial2, OPERATORS>().volume(80).step(8).release(10);
+    const AWPatch* PATCHES[] = {&jump, &pad, &slide, &glide, &fm};
+    
+    int failures = 0;
+    for(const AWPatch* patch : PATCHES) {
+        for(std::uint8_t key : {40, 69, 100}) {
+            for(std::uint32_t position : {512U, 700U, 1536U, 8741U, 46080U, 46111U}) {
+                for(std::int32_t release : {-1, 700, 1024, static_cast<std::int32_t>(position)}) {
+                    std::uint32_t diffs = checkVoice(*patch, key, position, release);
+                    if(diffs > 0) {
+                        std::printf("FAIL: voice key %u seek %u release %d: %u samples differ\n", key, position, release, diffs);
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+    
+    // Units of 64 ms, so that notes start on buffer boundaries when the tune plays through
+    static constexpr std::uint32_t UNIT_MS = 512 * 1000 / POK_AUD_FREQ;
+    static const std::uint8_t TUNE[] = {40,1, 44,2, 89,1, 47,1, 52,3, 89,2, 40,1, 45,1, 50,2, 89,4};
+    static Audio::SimpleTuneAW<CHANNEL, TIMER> tune;
+    
+    std::uint32_t length = 0;
+    std::vector<std::uint32_t> starts;
+    for(std::uint32_t idx = 0; idx < sizeof(TUNE); idx += 2) {
+        starts.push_back(length);
+        length += TUNE[idx+1] * UNIT_MS;
+    }
+    std::uint32_t end = (length + 20*UNIT_MS) * POK_AUD_FREQ / 1000;
+    
+    for(const AWPatch* patch : PATCHES) {
+        std::vector<std::uint8_t> ref;
+        stop();
+        tune.setup(UNIT_MS, *patch, TUNE, sizeof(TUNE));
+        playTune(ref, 0, end);
+        
+        for(std::uint32_t note = 0; note < starts.size(); ++note) {
+            std::uint32_t next = note + 1 < starts.size() ? starts[note+1] : length;
+            for(std::uint32_t ms : {starts[note], starts[note] + 3, (starts[note] + next) / 2}) {
+                if(ms >= next) {
+                    continue;
+                }
+                
+                std::vector<std::uint8_t> got;
+                std::uint32_t position = ms * POK_AUD_FREQ / 1000;
+                stop();
+                tune.setup(UNIT_MS, *patch, TUNE, sizeof(TUNE));
+                tune.seek(ms);
+                playTune(got, position, end);
+                
+                // Between notes, the next one starts on the next buffer instead of exactly on time
+                bool boundary = ms == starts[note];
+                std::uint32_t diffs = compare(ref, position, got, boundary ? got.size() : (next - ms) * POK_AUD_FREQ / 1000);
+                if(diffs > 0) {
+                    std::printf("FAIL: tune seek to %u ms (%s note start): %u samples differ\n", ms, boundary ? "on" : "after", diffs);
+                    ++failures;
+                }
+            }
+        }
+    }
+    
+    // Far into a long note, where the sample count overflows 32 bits if it's computed from milliseconds in 32 bits
+    {
+        static const std::uint8_t LONG[] = {40,100, 89,1};
+        std::vector<std::uint8_t> ref, got;
+        stop();
+        tune.setup(10000, pad, LONG, sizeof(LONG));
+        tune.seek(900000);
+        render(got, 4);
+        stop();
+        AWSynthSource::play<CHANNEL, false>(pad, 23+40).seek(static_cast<std::uint64_t>(900000) * POK_AUD_FREQ / 1000);
+        render(ref, 4);
+        std::uint32_t diffs = compare(ref, 0, got, got.size());
+        if(diffs > 0) {
+            std::printf("FAIL: tune seek to 900000 ms into a note: %u samples differ\n", diffs);
+            ++failures;
+        }
+    }
+    
+    stop();
+    auto& voice = AWSynthSource::play<CHANNEL, false>(pad, 60);
+    auto start = std::chrono::steady_clock::now();
+    voice.seek(512000);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    std::printf("seek of 512000 samples: %.0f ns\n", ns);
+    
+    std::printf(failures ? "seek: %d failures\n" : "seek: ok\n", failures);
+    return failures != 0;
+}
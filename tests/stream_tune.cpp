@@ -0,0 +1,65 @@
+// Plays tunes of different lengths with StreamTuneAW and checks that every note is played once and the tune stops,
+// also when the tune ends exactly at the end of a chunk.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I. tests/stream_tune.cpp -o stream_tune && ./stream_tune
+
+#include <cstdio>
+#include "AWSynthSource.h"
+#include "StreamTuneAW.h"
+
+using Audio::AWPatch;
+
+static constexpr std::uint32_t CHANNEL = 0;
+static constexpr std::uint32_t TIMER = ~0U - CHANNEL;
+
+// Writes a tune of 'notes' notes and returns its path
+static const char* writeTune(std::uint32_t notes) {
+    static const char* path = "/tmp/awsynth_stream_tune.bin";
+    std::FILE* file = std::fopen(path, "wb");
+    for(std::uint32_t idx = 0; idx < notes; ++idx) {
+        std::uint8_t note[2] = {static_cast<std::uint8_t>(1 + idx % 88), 1};
+        std::fwrite(note, 1, 2, file);
+    }
+    std::fclose(file);
+    return path;
+}
+
+// Plays the tune to the end and returns the number of notes played. With 'lazy' the chunks are only read after the
+// player has run out of them.
+static std::uint32_t play(std::uint32_t notes, bool lazy) {
+    auto patch = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return Audio::AWSynthSource::sqr(p); });
+    auto& tune = Audio::playStreamTuneAW<CHANNEL>(writeTune(notes), patch);
+    
+    std::uint32_t played = 0;
+    std::uint32_t underruns = tune.underruns();
+    while(Schedule::host::run<TIMER>() && played <= notes) {
+        bool underrun = tune.underruns() != underruns;
+        underruns = tune.underruns();
+        if(!underrun && Schedule::host::Timer<TIMER>::call) {
+            ++played;
+        }
+        if(!lazy || underrun) {
+            tune.prefetch();
+        }
+    }
+    tune.stop();
+    return played;
+}
+
+int main() {
+    constexpr auto CHUNK_NOTES = Audio::StreamTuneAW<CHANNEL, TIMER>::CHUNK_SIZE / 2;
+    
+    int failures = 0;
+    for(std::uint32_t notes : {0U, 1U, CHUNK_NOTES - 1, CHUNK_NOTES, CHUNK_NOTES + 1, 2*CHUNK_NOTES, 3*CHUNK_NOTES,
+                               3*CHUNK_NOTES + 5, 8*CHUNK_NOTES}) {
+        for(bool lazy : {false, true}) {
+            std::uint32_t played = play(notes, lazy);
+            if(played != notes) {
+                std::printf("FAIL: %u notes (%s prefetch) played %u notes\n", notes, lazy ? "lazy" : "eager", played);
+                ++failures;
+            }
+        }
+    }
+    
+    std::printf(failures ? "stream_tune: %d failures\n" : "stream_tune: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,88 @@
+// Checks the events logged by AWTrace: positions of the first sound inside and outside audio_buffer, no control
+// value updates unless PROJ_AWSYNTH_TRACE_UPDATES is defined, and a single release at the end of the level envelope
+// when the control values are computed ahead.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -DPROJ_AWSYNTH_TRACE -Dprivate=public -Itests/host -I. tests/trace.cpp -o trace && ./trace
+// FLAGS: -DPROJ_AWSYNTH_TRACE -Dprivate=public
+
+#include <cstdio>
+#include "AWSynthSource.h"
+#include "AWControlAhead.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+using Audio::AWTrace;
+using Event = AWTrace::Event;
+
+// Number of logged events of type 'event', and the argument of the last one
+static std::uint32_t count(Event event, std::uint32_t* arg=nullptr) {
+    std::uint32_t found = 0;
+    for(std::uint32_t idx = 0; idx < AWTrace::_count && idx < AWTrace::SIZE; ++idx) {
+        if(AWTrace::_entries[idx].event == event) {
+            ++found;
+            if(arg) {
+                *arg = AWTrace::_entries[idx].arg;
+            }
+        }
+    }
+    return found;
+}
+
+int main() {
+    // Silent for the first samples, so that the first sound isn't at the start of the buffer
+    auto patch = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return t < 100 ? 0 : AWSynthSource::sqr(p); })
+        .volume(80).step(1).release(2)
+        .amplitudes(AWPatch::Envelope(31,31,31,31));
+    
+    int failures = 0;
+    auto check = [&](bool ok, const char* what) {
+        if(!ok) {
+            std::printf("FAIL: %s\n", what);
+            ++failures;
+        }
+    };
+    
+    // Voice of a channel, rendered into the third buffer of audio_buffer
+    AWTrace::clear();
+    AWSynthSource::play<1, false>(patch, 60);
+    std::uint8_t* buffer = Audio::audio_buffer + 2*512;
+    Audio::host::fill(1, buffer);
+    std::uint32_t first = 0;
+    while(first < 512 && buffer[first] == 128) {
+        ++first;
+    }
+    std::uint32_t pos = 0;
+    check(count(Event::FIRST_SOUND, &pos) == 1 && pos == 2*512 + first, "first sound of a channel is at its position in audio_buffer");
+    check(count(Event::UPDATE) == 0, "no updates are logged by default");
+    
+    // Voice of an engine, rendered into a buffer of its own
+    AWTrace::clear();
+    Audio::AWEngine<2> engine;
+    engine.play(0, patch, 60);
+    std::uint8_t own[512];
+    engine.render(own);
+    check(count(Event::FIRST_SOUND, &pos) == 1 && pos == AWTrace::NO_POSITION, "first sound outside audio_buffer has no position");
+    
+    // Envelope ends within the buffers computed ahead, but the release is only logged once it's played
+    AWTrace::clear();
+    Audio::AWControlAhead<2>::play<false>(patch, 60);
+    Audio::AWControlAhead<2>::computeAhead();
+    check(count(Event::RELEASE) == 0, "release isn't logged while computing ahead");
+    for(std::uint32_t idx = 0; idx < 8 && Audio::host::function[2]; ++idx) {
+        Audio::host::fill(2, buffer);
+        Audio::AWControlAhead<2>::computeAhead();
+    }
+    check(Audio::AWControlAhead<2>::framedBuffers() > 0, "buffers were computed ahead");
+    check(count(Event::RELEASE) == 1, "release is logged once when played");
+    check(count(Event::STOP) == 1, "voice stopped");
+    
+    // Release at the end of the envelope of a voice that updates itself
+    AWTrace::clear();
+    AWSynthSource::play<1, false>(patch, 60);
+    for(std::uint32_t idx = 0; idx < 8 && Audio::host::function[1]; ++idx) {
+        Audio::host::fill(1, buffer);
+    }
+    check(count(Event::RELEASE) == 1, "release at the end of the envelope is logged");
+    
+    std::printf(failures ? "trace: %d failures\n" : "trace: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,104 @@
+// Checks AWTriggers: merging of triggers of the same note within the window, the limits per patch, and the audio clock
+// when audio_playHead wraps around between triggers. The buffer fill is run like the interrupt would, filling a buffer
+// whenever the play head crosses into the next one.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I. tests/triggers.cpp -o triggers && ./triggers
+
+#include <cstdio>
+#include "AWTriggers.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+using Audio::AWTriggers;
+
+static constexpr std::uint32_t RING = 512*Audio::bufferCount;
+
+static int failures = 0;
+
+// Sample time of the play head, which audio_playHead has modulo the ring of buffers
+static std::uint32_t head = 0;
+
+static void check(bool ok, const char* what) {
+    if(!ok) {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static void seek(std::uint32_t time) {
+    head = time;
+    Audio::audio_playHead = head % RING;
+}
+
+// Moves the play head on by 'samples', filling a buffer at each buffer boundary
+static void advance(std::uint32_t samples) {
+    std::uint32_t end = head + samples;
+    for(std::uint32_t next = (head/512 + 1)*512; next <= end; next += 512) {
+        seek(next);
+        std::uint8_t buffer[512];
+        Audio::host::fill(buffer);
+    }
+    seek(end);
+}
+
+static bool playing(unsigned channel) { return Audio::host::function[channel] != nullptr; }
+
+int main() {
+    static auto coin = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p); })
+        .volume(80).step(2).release(4)
+        .amplitudes(AWPatch::Envelope(31,31,28,24,20,16,12,8,4,0))
+        .semitones(AWPatch::Envelope(0,12,12,12,12,12,12,12,12,12));
+    static auto hum = AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::tri(p); })
+        .volume(60).step(4).release(8)
+        .amplitudes(AWPatch::Envelope(31,31).loop(0,2));
+    
+    // Triggers of the same note within the window are merged, others play
+    auto* a = AWTriggers::play<0>(coin, 60);
+    auto* b = AWTriggers::play<1>(coin, 60);
+    auto* c = AWTriggers::play<1>(coin, 61);
+    check(a != nullptr && a == b && AWTriggers::merged() == 1, "same note within the window isn't merged");
+    check(c != nullptr && c != a, "other key is merged");
+    advance(200);   // 25 ms, longer than the window
+    auto* d = AWTriggers::play<2>(coin, 60);
+    check(d != nullptr && d != a && AWTriggers::merged() == 1, "same note after the window is merged");
+    
+    // Triggers closer than the interval are dropped
+    AWTriggers::limit(coin, 0, 50);
+    check(AWTriggers::play<3>(coin, 62) == nullptr && AWTriggers::dropped() == 1, "trigger within the interval plays");
+    advance(50*POK_AUD_FREQ/1000);
+    check(AWTriggers::play<3>(coin, 62) != nullptr && AWTriggers::dropped() == 1, "trigger after the interval is dropped");
+    AWTriggers::clearLimit(coin);
+    
+    // A voice that has faded out doesn't take triggers, even if the clock missed a wrap-around of the play head
+    AWTriggers::resetCounts();
+    AWTriggers::play<0>(coin, 60);
+    for(std::uint32_t idx = 0; idx < 10; ++idx) {
+        std::uint8_t buffer[512];
+        Audio::host::fill(buffer);
+    }
+    seek(head + RING + 40);
+    AWTriggers::play<0>(coin, 60);
+    check(AWTriggers::merged() == 0 && playing(0), "trigger is merged into a voice that has faded out");
+    
+    // Nor does a released one
+    AWTriggers::resetCounts();
+    AWTriggers::play<1>(hum, 60)->release();
+    AWTriggers::play<1>(hum, 60);
+    check(AWTriggers::merged() == 0, "trigger is merged into a released voice");
+    
+    // The buffer fill keeps the clock going when nothing else calls AWTriggers for a whole ring of buffers
+    AWTriggers::resetCounts();
+    AWTriggers::limit(hum, 0, 100);
+    advance(100*POK_AUD_FREQ/1000);
+    AWTriggers::play<2>(hum, 72);
+    advance(RING + 40);
+    AWTriggers::play<2>(hum, 72);
+    check(AWTriggers::merged() == 0, "trigger a ring later is merged");
+    
+    advance(100*POK_AUD_FREQ/1000);
+    AWTriggers::play<3>(hum, 74);
+    advance(RING + 40);
+    check(AWTriggers::play<3>(hum, 75) != nullptr && AWTriggers::dropped() == 0, "trigger a ring later is dropped by the interval");
+    
+    std::printf(failures ? "triggers: %d failures\n" : "triggers: ok\n", failures);
+    return failures != 0;
+}
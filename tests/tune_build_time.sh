@@ -0,0 +1,50 @@
+#!/bin/sh
+# Measures how long SIMPLE_TUNE_AW takes to compile for tunes of different lengths. Each tune of random notes, rests
+# and durations is compiled on its own, and a static_assert checks the length of the generated array. Run from the
+# repository root:
+#     tests/tune_build_time.sh                # Tunes of 100, 1000 and 10000 notes
+#     tests/tune_build_time.sh 500 5000       # Other lengths
+# Set CXX to use another compiler. Exits with a non-zero status if a tune doesn't compile.
+
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++17 -O2 -Wno-narrowing -Itests/host -I."
+WORK=/tmp/awsynth_tune_build.$$
+
+mkdir -p "$WORK" || exit 1
+status=0
+
+for notes in ${*:-100 1000 10000}; do
+    awk -v notes="$notes" 'BEGIN {
+        srand(notes);
+        split("A B C D E F G", names, " ");
+        printf "#include \"SimpleTuneAW.h\"\n";
+        printf "constexpr auto tune = SIMPLE_TUNE_AW(";
+        for(i = 0; i < notes; ++i) {
+            if(i > 0) printf(i % 16 ? ", " : ",\n    ");
+            if(rand() < 0.1) {
+                printf "X";
+            }
+            else {
+                printf "%s%s%d", names[int(rand()*7) + 1], rand() < 0.3 ? "#" : "-", int(rand()*4) + 2;
+            }
+            r = rand();
+            if(r < 0.2) printf "*%d", int(rand()*4) + 2;
+            else if(r < 0.3) printf "/2";
+        }
+        printf ").tempo(120*4);\n";
+        printf "static_assert(tune.size() == %d*2);\n", notes;
+        printf "int main() { return tune[0]; }\n";
+    }' > "$WORK/tune.cpp"
+    
+    start=$(date +%s.%N)
+    if $CXX $FLAGS -c "$WORK/tune.cpp" -o "$WORK/tune.o"; then
+        end=$(date +%s.%N)
+        awk -v notes="$notes" -v start="$start" -v end="$end" 'BEGIN { printf "%6d notes: %.2f s\n", notes, end - start }'
+    else
+        echo "$notes notes: FAILED"
+        status=1
+    fi
+done
+
+rm -rf "$WORK"
+exit $status
@@ -0,0 +1,99 @@
+// Checks that AWVoiceBank plays the same samples as AWEngine. The voices of a bank share one control clock, while each
+// engine voice starts its own at play(), so the notes are started on buffers that begin on a control period boundary.
+// Covers smooth envelopes, loops, pitch slides and decays, glide, user data and releases.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Dprivate=public -Itests/host -I. tests/voice_bank.cpp -o voice_bank && ./voice_bank
+// FLAGS: -Dprivate=public
+
+#include <cstdio>
+#include <cstring>
+#include "AWVoiceBank.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+
+static constexpr unsigned VOICES = 8;
+static constexpr std::uint32_t BUFFERS = 1500;
+
+// Samples between control value updates
+static constexpr std::uint32_t PERIOD = (AWSynthSource::_ONE_Q20 + AWSynthSource::_CV_RATE_Q20 - 1) / AWSynthSource::_CV_RATE_Q20;
+
+static std::uint32_t shared = 36;
+
+static const AWPatch patches[] = {
+    AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p); })
+        .volume(80).step(4).release(0)
+        .amplitudes(AWPatch::Envelope(31,31,31,29,28,26,24,22,20,18,16,14,12, 0).loop(32,14))
+        .semitones(AWPatch::Envelope(0,0,2,4,6,8,10,12,14,16,18,20,22,24).smooth(true).loop(13,14)),
+    AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::tri(p); })
+        .volume(90).step(3).glide(10).release(20)
+        .amplitudes(AWPatch::Envelope(31,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16).smooth(true).loop(4,17))
+        .semitones(AWPatch::Envelope(0,3,7,12,-5,2,0,1).effects(0,3,3,1,2,3,0,0).loop(0,8)),
+    AWPatch([](std::uint32_t t, std::uint32_t p, void* data)->std::int32_t {
+            return AWSynthSource::saw(p*(*static_cast<std::uint32_t*>(data))>>5);
+        }, shared)
+        .volume(70).step(5).release(10)
+        .amplitudes(AWPatch::Envelope(10,31,20,25,15,0).effects(1,3,2,3,3,3).loop(1,5)),
+};
+
+template<typename Voices>
+static void playAll(Voices& voices, std::uint32_t round) {
+    for(unsigned idx = 0; idx < VOICES; ++idx) {
+        voices.play(idx, patches[(idx + round) % 3], 40 + (idx*7 + round*5) % 40);
+    }
+}
+
+int main() {
+    int failures = 0;
+    
+    static Audio::AWEngine<VOICES> engine;
+    static Audio::AWVoiceBank<VOICES> bank;
+    
+    // Every PERIOD buffers start on a control period boundary. Notes start on one of those about every 100 buffers.
+    std::uint32_t aligned = PERIOD;
+    while(aligned < 70) {
+        aligned += PERIOD;
+    }
+    
+    std::uint32_t diffs = 0;
+    std::int32_t first = -1;
+    for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+        if(idx % aligned == 0) {
+            playAll(engine, idx / aligned);
+            playAll(bank, idx / aligned);
+        }
+        if(idx % aligned == aligned*2/3) {
+            for(unsigned voice = 0; voice < VOICES; voice += 3) {
+                engine.release(voice);
+                bank.release(voice);
+            }
+        }
+        
+        std::uint8_t ref[512], got[512];
+        engine.render(ref);
+        bank.render(got);
+        if(std::memcmp(ref, got, 512) != 0) {
+            ++diffs;
+            first = first < 0 ? idx : first;
+        }
+        for(unsigned voice = 0; voice < VOICES; ++voice) {
+            if(engine.isPlaying(voice) != bank.isPlaying(voice)) {
+                std::printf("FAIL: voice %u is %s in the engine after buffer %u\n", voice, engine.isPlaying(voice) ? "playing" : "stopped", idx);
+                ++failures;
+            }
+        }
+    }
+    if(diffs > 0) {
+        std::printf("FAIL: %u of %u buffers differ from AWEngine, first at %d\n", diffs, BUFFERS, first);
+        ++failures;
+    }
+    
+    // Patches that need the state of a whole voice are not played
+    AWPatch unison = AWPatch(patches[0]).unison(3, 10);
+    if(bank.play(0, unison)) {
+        std::printf("FAIL: bank plays a unison patch\n");
+        ++failures;
+    }
+    
+    std::printf(failures ? "voice_bank: %d failures\n" : "voice_bank: ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,76 @@
+// Measures the time AWEngine and AWVoiceBank take per sample and voice with 4, 8, 16 and 32 voices. Every 50 buffers
+// all voices start new notes of three callback patches, and every other voice is released 40 buffers later. Best of
+// 5 runs of 2000 buffers.
+//     g++ -std=gnu++17 -O2 -Wno-narrowing -Itests/host -I. tests/voice_bank_bench.cpp -o voice_bank_bench && ./voice_bank_bench
+
+#include <chrono>
+#include <cstdio>
+#include "AWVoiceBank.h"
+
+using Audio::AWPatch;
+using Audio::AWSynthSource;
+
+static std::uint32_t shared = 36;
+
+static const AWPatch patches[] = {
+    AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::sqr(p); })
+        .volume(80).step(4).release(0)
+        .amplitudes(AWPatch::Envelope(31,31,31,29,28,26,24,22,20,18,16,14,12, 0).loop(32,14))
+        .semitones(AWPatch::Envelope(0,0,2,4,6,8,10,12,14,16,18,20,22,24).smooth(true).loop(13,14)),
+    AWPatch([](std::uint32_t t, std::uint32_t p)->std::int32_t { return AWSynthSource::tri(p); })
+        .volume(90).step(3).glide(10).release(20)
+        .amplitudes(AWPatch::Envelope(31,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16).smooth(true).loop(4,17))
+        .semitones(AWPatch::Envelope(0,3,7,12,-5,2,0,1).effects(0,3,3,1,2,3,0,0).loop(0,8)),
+    AWPatch([](std::uint32_t t, std::uint32_t p, void* data)->std::int32_t {
+            return AWSynthSource::saw(p*(*static_cast<std::uint32_t*>(data))>>5);
+        }, shared)
+        .volume(70).step(5).release(10)
+        .amplitudes(AWPatch::Envelope(10,31,20,25,15,0).effects(1,3,2,3,3,3).loop(1,5)),
+};
+
+template<typename Voices, unsigned count>
+static double bench(std::uint32_t& sum) {
+    static Voices voices;
+    constexpr std::uint32_t BUFFERS = 2000;
+    double best = 1e9;
+    for(std::uint32_t run = 0; run < 5; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for(std::uint32_t idx = 0; idx < BUFFERS; ++idx) {
+            if(idx % 50 == 0) {
+                for(unsigned voice = 0; voice < count; ++voice) {
+                    voices.play(voice, patches[(voice + idx/50) % 3], 40 + (voice*7 + idx/50*5) % 40);
+                }
+            }
+            if(idx % 50 == 40) {
+                for(unsigned voice = 0; voice < count; voice += 2) {
+                    voices.release(voice);
+                }
+            }
+            
+            std::uint8_t buffer[512];
+            voices.render(buffer);
+            sum += buffer[idx & 511];
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (BUFFERS*512.0*count);
+        best = ns < best ? ns : best;
+    }
+    return best;
+}
+
+template<unsigned count>
+static void row(std::uint32_t& sum) {
+    double engine = bench<Audio::AWEngine<count>, count>(sum);
+    double bank = bench<Audio::AWVoiceBank<count>, count>(sum);
+    std::printf("%6u  %8.2f  %11.2f\n", count, engine, bank);
+}
+
+int main() {
+    std::uint32_t sum = 0;
+    std::printf("voices  AWEngine  AWVoiceBank  (ns per sample per voice)\n");
+    row<4>(sum);
+    row<8>(sum);
+    row<16>(sum);
+    row<32>(sum);
+    std::printf("checksum %u\n", sum);
+    return 0;
+}